@@ -4,101 +4,135 @@
 // ============================================================================
 //
 #include <stdint.h>
-#include <avr/io.h>
-#include <avr/pgmspace.h>
 //
+#include "hal.h"
 #include "servoturnout.h"
 #include "button.h"
-#include "led.h"
+#include "timebase.h"
 //
-// ============================================================================
+_Static_assert( (BTN_QUEUE_SIZE & (BTN_QUEUE_SIZE-1)) == 0, "button queue size must be a power of two" );
 //
-button_t buttons[BUTTON_COUNT] = {
-	{ 1<<BTPLUS_PIN,	BTNRELEASEDSTATE,	BTNRELEASEDSTATE,	0 },
-	{ 1<<BTMINUS_PIN,	BTNRELEASEDSTATE,	BTNRELEASEDSTATE,	0 },
-	{ 1<<BTS1_PIN,		BTNRELEASEDSTATE,	BTNRELEASEDSTATE,	0 },
-	{ 1<<BTS2_PIN,		BTNRELEASEDSTATE,	BTNRELEASEDSTATE,	0 },
-};
+#define BTN_QUEUE_MASK		(BTN_QUEUE_SIZE-1)
 //
 // ============================================================================
-// btnPinRead -- Read the Port:Bit associated with a specific button
 //
-// return BTNPRESSED iff button is pressed
-// return BTNRELEASED iff button is released,
-//
-static uint8_t btnPinRead( enum eButton btnId )
-{
-	if ( BTNPIN & buttons[btnId].btnPinMask ) {	// If PORT:PIN reads high the button is released
-		return BTNRELEASED;
-	}
-	else {
-		return BTNPRESSED;
-	}
-}
+uint8_t btnState = BTN_MASK;				// Debounced pin states, all released
+uint8_t btnQueueOverflows;					// Events dropped because the queue was full
+static volatile uint8_t btnPins = BTN_MASK;	// BTNPIN at the last pin change
+static volatile uint8_t btnBouncing;		// Pins changed and not yet confirmed
+static volatile uint16_t btnEdgeTime[BUTTON_COUNT];	// tbNow() of each button's last edge
+static uint8_t btnQueue[BTN_QUEUE_SIZE];	// Confirmed events
+static uint8_t btnQHead;					// Next free entry, free running
+static uint8_t btnQTail;					// Oldest event, free running
+//
+// BTNPIN bit for each enum eButton, 0 if the button isn't fitted
+static const uint8_t btnPinMask[BUTTON_COUNT] PROGMEM = {
+	BTN_FITTED( BTPLUS_PIN ), BTN_FITTED( BTMINUS_PIN ), 1<<BTS1_PIN, 1<<BTS2_PIN,
+};
 //
 // ============================================================================
 // btnConfig -- Configure the button interface
 //
-// Config each pin as input with pullup enabled and initialize the buttons array
-// to match the button state
+// Config each pin as input with pullup enabled and enable their pin change
+// interrupts. Every pin starts out bouncing, so one that is already low after
+// the pull-ups settle is reported as a press BTN_SETTLE_MS later.
 //
 // TODO: set PUD bit in MCUCR
 //
 void btnConfig( void )
 {
-	uint8_t idx;
+	uint16_t now = tbNow();
 
-	for ( idx=0; idx<BUTTON_COUNT; ++idx ) {
-		BTNDDR &= ~(buttons[idx].btnPinMask);	// Set port as input
-		BTNPORT |= buttons[idx].btnPinMask;		// Activate pull-up
-	}
+	BTNDDR &= ~BTN_MASK;					// Set port as input
+	BTNPORT |= BTN_MASK;					// Activate pull-up
+
+	for ( uint8_t idx=0; idx<BUTTON_COUNT; ++idx )
+		btnEdgeTime[idx] = now;
+	btnBouncing = BTN_MASK;
+
+	BTNPCMSK |= BTN_MASK;
+	GIMSK |= (1<<BTNPCIE);
+	btnPins = BTNPIN & BTN_MASK;			// Later changes raise the interrupt
 }
 //
 // ============================================================================
-// btnChanged -- Return 1 if button state has changed, 0 otherwise
-//
-// in	- btnId - is a Button enum
+// PCINT_D -- Pin change ISR for the buttons
 //
-// NB: This function has the side effect of clearing btnChangeFlag
+// Costs one snapshot and a timestamp per changed button, the debounce decision
+// is left to btnHeartBeat().
 //
-uint8_t btnChanged( enum eButton btnId )
+ISR(PCINT_D_vect)
 {
-	uint8_t retChanged = 0;
+	uint8_t		pins = BTNPIN & BTN_MASK;
+	uint8_t		changed = pins ^ btnPins;
+	uint16_t	now;
+
+	if ( 0 == changed )
+		return;
 
-	if ( buttons[btnId].btnChangeFlag ) {
-		retChanged = 1;
+	now = tbNow();
+	btnPins = pins;
+	btnBouncing |= changed;
+	for ( uint8_t idx=0; idx<BUTTON_COUNT; ++idx ) {
+		if ( changed & pgm_read_byte( &btnPinMask[idx] ) )
+			btnEdgeTime[idx] = now;
 	}
+}
+//
+// ============================================================================
+// btnEvent -- Return the next button event, BTN_EVENT_NONE if there is none
+//
+uint8_t btnEvent( void )
+{
+	uint8_t event;
 
-	buttons[btnId].btnChangeFlag = 0;		// Clear button changed flag
+	if ( btnQHead == btnQTail )
+		return BTN_EVENT_NONE;
 
-	return retChanged;
+	event = btnQueue[ btnQTail & BTN_QUEUE_MASK ];
+	++btnQTail;
+	return event;
 }
 //
 // ============================================================================
 // btnHeartBeat -- Do heartbeat processing for the buttons
 //
+// A bouncing pin that has had no edge for BTN_SETTLE_MS is settled. If it
+// settled at a different level from btnState that is a press or release,
+// otherwise it was a glitch.
+//
 void btnHeartBeat( void )
 {
-	enum eButton	idx;
-	uint8_t			pinState;				// 0 or 1
-	uint8_t			btnPin = BTNPIN;		// Read state of all the buttons
+	uint8_t		bouncing = btnBouncing;
+	uint8_t		pins, mask, quiet;
 
-	for ( idx=0; idx<BUTTON_COUNT; ++idx ) {
-		pinState = btnPinRead( idx );
-		// Accumulate current pin state into recent button history
-		buttons[idx].btnCurrentState = (buttons[idx].btnCurrentState<<2) | (pinState<<1)|pinState;
-//		buttons[idx].btnCurrentState = (pinState==BTNPRESSED) ? BTNPRESSEDSTATE : BTNRELEASEDSTATE;
-		if ( (buttons[idx].btnCurrentState == BTNPRESSEDSTATE) ||
-					(buttons[idx].btnCurrentState == BTNRELEASEDSTATE) ) {
-			if ( buttons[idx].btnCurrentState != buttons[idx].btnLastState ) {
-				buttons[idx].btnLastState = buttons[idx].btnCurrentState;
-				buttons[idx].btnChangeFlag = 1;
-			}
+	if ( 0 == bouncing )
+		return;
+
+	for ( uint8_t idx=0; idx<BUTTON_COUNT; ++idx ) {
+		mask = pgm_read_byte( &btnPinMask[idx] );
+		if ( !(bouncing & mask) )
+			continue;
+
+		// An edge arriving after this block starts the wait over again
+		ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+			quiet = ( (uint16_t)(tbNow() - btnEdgeTime[idx]) >= TB_MS( BTN_SETTLE_MS ) );
+			if ( quiet )
+				btnBouncing &= ~mask;
+			pins = btnPins;
 		}
-	}
-//if ( buttons[btnMinus].btnCurrentState==BTNPRESSEDSTATE ) { ledOn(LED1); ledOff(LED2); }
-//if ( buttons[btnMinus].btnCurrentState==BTNRELEASEDSTATE ) { ledOff(LED1); ledOn(LED2); }
+		if ( !quiet || !((pins ^ btnState) & mask) )
+			continue;
 
+		btnState ^= mask;
+		if ( (uint8_t)(btnQHead - btnQTail) < BTN_QUEUE_SIZE ) {
+			btnQueue[ btnQHead & BTN_QUEUE_MASK ] = idx | ( (pins & mask) ? 0 : BTN_EVENT_PRESS );
+			++btnQHead;
+		}
+		else {
+			++btnQueueOverflows;
+		}
+	}
 }
 //
 // ============================================================================
@@ -1,4 +1,3 @@
-
 #ifndef _BUTTON_H_
 #define _BUTTON_H_
 //
@@ -15,15 +14,15 @@
 //	BTS2	PD3
 //
 // ============================================================================
-// Button data structures and data
+// Debouncing
 //
-typedef struct {
-	uint8_t		btnPinMask;		// Which port pin is associated with this button
-	uint8_t		btnLastState;	// Last stable state of this button
-	uint8_t		btnCurrentState;// Current, perhaps unstable, state of this button
-	uint8_t		btnChangeFlag;	// Flagged as changed when btnCurrentState is stable
-								// and doesn't match btnLastState
-} button_t;
+// The buttons are on pin change interrupts PCINT11-14 (PCMSK2). The ISR takes
+// one BTNPIN snapshot, timestamps each pin that changed with tbNow() and wakes
+// the CPU. btnHeartBeat() confirms a pin once it has been quiet for
+// BTN_SETTLE_MS and differs from its debounced state, and queues a press or
+// release event. So a press is seen on the first tic BTN_SETTLE_MS after the
+// contacts stop bouncing, rather than after 4 tics of polling, and nothing is
+// done on tics where no pin has changed.
 //
 // ============================================================================
 // Button defines
@@ -36,23 +35,45 @@ enum eButton { btnPlus, btnMinus, btnServo1, btnServo2 };
 #define BTNPRESSED			0		// Pin state when button is pressed
 #define BTNRELEASED			1		// Pin state when button is not pressed
 //
-#define BTNPRESSEDSTATE		0x00	// Debounced button state when button is pressed
-#define BTNRELEASEDSTATE	0xFF	// Debounced button state when button is released
-//
 #define BTNPORT				PORTD
 #define BTNDDR				DDRD
 #define BTNPIN				PIND
+#define BTNPCMSK			PCMSK2
+#define BTNPCIE				PCIE2
 //
 #define BTPLUS_PIN			0
 #define BTMINUS_PIN			1
 #define BTS1_PIN			2
 #define BTS2_PIN			3
 //
+// With UART_CONSOLE, PD0/PD1 are RXD/TXD and BTPLUS/BTMINUS aren't fitted
+#ifdef UART_CONSOLE
+#define BTN_FITTED(pin)		0
+#else
+#define BTN_FITTED(pin)		(1<<(pin))
+#endif
+#define BTN_MASK			(BTN_FITTED( BTPLUS_PIN ) | BTN_FITTED( BTMINUS_PIN ) | (1<<BTS1_PIN) | (1<<BTS2_PIN))
+//
+#ifndef BTN_SETTLE_MS
+#define BTN_SETTLE_MS		10		// Quiet time after the last edge before it counts
+#endif
+//
+// Events, an enum eButton in the low bits
+#define BTN_EVENT_PRESS		0x80	// Set for a press, clear for a release
+#define BTN_EVENT_ID		0x0F	// The enum eButton
+#define BTN_EVENT_NONE		0xFF	// btnEvent() when the queue is empty
+#define BTN_QUEUE_SIZE		8		// Power of two
+//
+// Debounced pin states, bit n is BTNPIN bit n. A button reads 0 (BTNPRESSED)
+// while pressed.
+extern uint8_t btnState;
+extern uint8_t btnQueueOverflows;	// Events dropped because the queue was full
+//
 // ============================================================================
 // Button interface functions
 void btnConfig( void );						// Initialize ports to support the buttons
-uint8_t btnChanged( enum eButton btnId );	// Return 1 if a button state has changed
-void btnHeartBeat( void );					// Update button data structure based on hardware state
+uint8_t btnEvent( void );					// Next button event, BTN_EVENT_NONE if none
+void btnHeartBeat( void );					// Confirm settled pin changes as events
 //
 // ============================================================================
 //
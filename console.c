@@ -0,0 +1,287 @@
+//
+// ============================================================================
+//
+// console.c -- Serial command interface for the servoturnout program
+//
+// ============================================================================
+//
+#include <stdint.h>
+//
+#include "hal.h"
+#include "servoturnout.h"
+//
+#include "servo.h"
+#include "motion.h"
+#include "rom.h"
+#include "uart.h"
+#include "telemetry.h"
+#include "frog.h"
+#include "console.h"
+//
+#ifdef UART_CONSOLE
+//
+_Static_assert( CONSOLE_REPLY_MAX <= UART_TX_SIZE, "a reply must fit in the transmit ring" );
+//
+// Cruise speed conversions, motion_t.vMax is Q8.8 position units per tic
+#define CONSOLE_VMAX(usps)	((uint32_t)(usps) * SERVO_UNITS_PER_US * 256 / SERVO_HZ)
+#define CONSOLE_USPS(vmax)	((uint32_t)(vmax) * SERVO_HZ / (SERVO_UNITS_PER_US * 256))
+// Acceleration, motion_t.accel is Q8.8 position units per tic per tic
+#define CONSOLE_ACCEL(usps2)	((uint32_t)(usps2) * SERVO_UNITS_PER_US * 256 / (SERVO_HZ * SERVO_HZ))
+//
+// ============================================================================
+//
+uint16_t		consoleCommands;
+static char		consoleLine[CONSOLE_LINE_SIZE];
+static uint8_t	consoleLen;							// CONSOLE_LINE_SIZE+1 once too long
+static uint8_t	consoleDump = SERVO_COUNT;			// Next servo to dump
+//
+static const char consoleOk[] PROGMEM = "ok\r\n";
+static const char consoleBad[] PROGMEM = "?\r\n";
+//
+// ============================================================================
+// consoleArgs -- Parse up to two unsigned decimal arguments after the command
+//
+// return the number of arguments, 0xFF if the line is malformed
+//
+static uint8_t consoleArgs( uint16_t arg[2] )
+{
+	uint8_t		idx = 1;
+	uint8_t		count = 0;
+	char		c;
+
+	for ( ;; ) {
+		while ( (idx < consoleLen) && (' ' == consoleLine[idx]) )
+			++idx;
+		if ( idx >= consoleLen )
+			return count;
+		if ( count >= 2 )
+			return 0xFF;
+
+		arg[count] = 0;
+		do {
+			c = consoleLine[idx];
+			if ( (c < '0') || (c > '9') || (arg[count] >= 6553) )
+				return 0xFF;
+			arg[count] = arg[count] * 10 + (c - '0');
+		} while ( (++idx < consoleLen) && (' ' != consoleLine[idx]) );
+		++count;
+	}
+}
+//
+// ============================================================================
+// consoleMotion -- Change one of servo idx's motion settings and save them
+//
+// return non-zero if the value was accepted
+//
+static uint8_t consoleMotion( uint8_t idx, char cmd, uint16_t value )
+{
+	motion_t	m = servo[idx].motion;		// Only the settings are used
+
+	switch ( cmd ) {
+		case 's':
+			if ( CONSOLE_VMAX( value ) > 0xFFFF )
+				return 0;
+			m.vMax = CONSOLE_VMAX( value );
+			break;
+
+		case 'a':
+			if ( CONSOLE_ACCEL( value ) > 0xFFFF )
+				return 0;
+			m.accel = CONSOLE_ACCEL( value );
+			break;
+
+		case 'p':
+			if ( value > profileSCurve )
+				return 0;
+			m.profile = value;
+			break;
+
+		default:
+			if ( value && ((value < MOTION_THROW_MIN_MS) || (value > MOTION_THROW_MAX_MS)) )
+				return 0;
+			m.throwTics = MOTION_THROW_TICS( value );
+			break;
+	}
+	return servoSetMotion( idx, &m );
+}
+//
+// ============================================================================
+// consoleExec -- Run the command in consoleLine[]
+//
+// return non-zero if the command was accepted
+//
+static uint8_t consoleExec( void )
+{
+	uint16_t	arg[2];
+	uint8_t		count;
+	uint8_t		idx;
+
+	if ( consoleLen > CONSOLE_LINE_SIZE )
+		return 0;
+
+	count = consoleArgs( arg );
+	if ( 0xFF == count )
+		return 0;
+	// Servo number, range checked before narrowing so "t 257" isn't servo 1
+	idx = ( count && arg[0] && (arg[0] <= SERVO_COUNT) ) ? arg[0] - 1 : SERVO_COUNT;
+
+	switch ( consoleLine[0] ) {
+		case 't':
+			if ( (1 != count) || (idx >= SERVO_COUNT) )
+				return 0;
+			servoToggle( idx );
+			return 1;
+
+#ifdef SERVO_POSITIONS
+		case '<':
+			if ( (1 != count) || (idx >= SERVO_COUNT) )
+				return 0;
+			servoStep( idx, 1 );
+			return 1;
+
+		case 'g':
+			if ( (2 != count) || (idx >= SERVO_COUNT) )
+				return 0;
+			return servoGoTo( idx, arg[1] );
+
+		case 'o':
+			if ( (2 != count) || (idx >= SERVO_COUNT) || (arg[1] > SERVO_ABSOLUTE_MAX / SERVO_UNITS_PER_US) )
+				return 0;
+			return servoSetPosition( idx, SERVO_US( arg[1] ) );
+
+		case 'c':
+			if ( (2 != count) || (idx >= SERVO_COUNT) || (arg[1] < 2) )
+				return 0;
+			return servoSetStops( idx, arg[1] - 2 );
+#endif
+
+		case 'm':
+		case 'x':
+			if ( (2 != count) || (idx >= SERVO_COUNT) || (arg[1] > SERVO_ABSOLUTE_MAX / SERVO_UNITS_PER_US) )
+				return 0;
+			return servoSetLimit( idx, SERVO_US( arg[1] ), 'x' == consoleLine[0] );
+
+		case 's':
+		case 'a':
+		case 'p':
+		case 'r':
+			if ( (2 != count) || (idx >= SERVO_COUNT) )
+				return 0;
+			return consoleMotion( idx, consoleLine[0], arg[1] );
+
+		case '+':
+			if ( count )
+				return 0;
+			servoWiden();
+			return 1;
+
+		case '-':
+			if ( count )
+				return 0;
+			servoNarrow();
+			return 1;
+
+		case 'd':
+			if ( count )
+				return 0;
+			consoleDump = 0;				// Sent by consolePoll(), then "ok"
+			return 1;
+
+		case 'w':
+			if ( count )
+				return 0;
+			romCommit();
+			return 1;
+
+#ifdef FROG_RELAY
+		case 'f':
+			if ( (2 != count) || (idx >= SERVO_COUNT) || (arg[1] > 99) )
+				return 0;
+			return frogSetPoint( idx, (arg[1] * 256 + 50) / 100 );
+#endif
+
+#ifdef UART_TELEMETRY
+		case 'b':
+			if ( (1 != count) || (arg[0] > telemOnChange) )
+				return 0;
+			telemSetMode( arg[0] );
+			return 1;
+#endif
+
+		default:
+			return 0;
+	}
+}
+//
+// ============================================================================
+// consoleDumpLine -- Send the next line of a dump if it fits
+//
+static void consoleDumpLine( void )
+{
+	const servoData_t * s = &servo[consoleDump];
+
+	if ( uartTxFree() < CONSOLE_REPLY_MAX )
+		return;
+
+	uartPutDec( consoleDump + 1 );
+	uartPutc( ' ' );
+	uartPutDec( s->currentPos / SERVO_UNITS_PER_US );
+	uartPutc( ' ' );
+	uartPutDec( s->targetPos / SERVO_UNITS_PER_US );
+	uartPutc( ' ' );
+	uartPutDec( s->minPos / SERVO_UNITS_PER_US );
+	uartPutc( ' ' );
+	uartPutDec( s->maxPos / SERVO_UNITS_PER_US );
+	uartPutc( ' ' );
+	uartPutDec( CONSOLE_USPS( s->motion.vMax ) );
+	uartPuts_P( PSTR( "\r\n" ) );
+
+	if ( ++consoleDump >= SERVO_COUNT )
+		uartPuts_P( consoleOk );
+}
+//
+// ============================================================================
+// consolePoll -- Run any complete command lines received
+//
+// Called on every pass of the main loop. Stops early, leaving the input in the
+// receive ring, while a dump is in progress or the transmit ring hasn't room
+// for a reply.
+//
+void consolePoll( void )
+{
+	uint8_t		n;
+	char		c;
+
+	for ( n=uartRxCount(); ; --n ) {
+		if ( consoleDump < SERVO_COUNT ) {
+			consoleDumpLine();
+			if ( consoleDump < SERVO_COUNT )
+				return;
+		}
+		if ( (0 == n) || (uartTxFree() < CONSOLE_REPLY_MAX) )
+			return;
+
+		c = uartGetc();
+		if ( ('\r' == c) || ('\n' == c) ) {
+			if ( consoleLen ) {
+				++consoleCommands;
+				if ( !consoleExec() )
+					uartPuts_P( consoleBad );
+				else if ( consoleDump >= SERVO_COUNT )
+					uartPuts_P( consoleOk );
+			}
+			consoleLen = 0;
+		}
+		else if ( consoleLen < CONSOLE_LINE_SIZE ) {
+			consoleLine[consoleLen++] = c;
+		}
+		else {
+			consoleLen = CONSOLE_LINE_SIZE + 1;		// Rejected at the end of the line
+		}
+	}
+}
+//
+#endif	// UART_CONSOLE
+//
+// ============================================================================
+//
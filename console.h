@@ -0,0 +1,62 @@
+#ifndef _CONSOLE_H_
+#define _CONSOLE_H_
+//
+// ============================================================================
+//
+// console.h -- Serial command interface for the servoturnout program, build
+//				with -DUART_CONSOLE
+//
+// ============================================================================
+//
+// One command per line, ended by CR or LF. n is a servo number from 1, times
+// in us. Replies are "ok" or "?", lines aren't echoed.
+//
+//	t n			Throw servo n to its other position, with SERVO_POSITIONS step
+//				forward through its table
+//	< n			Step servo n back through its table, needs SERVO_POSITIONS
+//	g n i		Send servo n to table entry i, 0 is min, needs SERVO_POSITIONS
+//	o n us		Set the position of servo n's present table entry, needs
+//				SERVO_POSITIONS
+//	c n k		Use k table entries, 2 to SERVO_POSITIONS, for servo n, needs
+//				SERVO_POSITIONS
+//	m n us		Set servo n's min position
+//	x n us		Set servo n's max position
+//	s n us		Set servo n's cruise speed, in us per second, 7 to 1593 in
+//				steps of 6.25
+//	a n us		Set servo n's acceleration (trapezoid), in us per second per
+//				second, 20 to 4980 in steps of about 19.5
+//	p n k		Set servo n's motion profile, 0 linear, 1 trapezoid, 2 S-curve
+//	r n ms		Set servo n's throw time, 200 to 30000ms, or 0 to go back to
+//				moving at the cruise speed, see motion.h
+//	+			Widen the most recently thrown servo, as BTNPLUS
+//	-			Narrow the most recently thrown servo, as BTNMINUS
+//	d			Dump every servo as "n current target min max speed"
+//	w			Queue the servo data for the EEPROM now
+//	f n pct		Set servo n's frog relay switch point, percent of the way from
+//				min to max, needs FROG_RELAY, see frog.h
+//	b n			Binary telemetry off (0), every tic (1) or on change (2), needs
+//				UART_TELEMETRY, see telemetry.h
+//
+// Speed, acceleration, profile and throw time are saved in the EEPROM board
+// settings as soon as they are set, see rom.h.
+//
+// Limit changes are committed the same way as BTNPLUS/BTNMINUS presses, after
+// ROM_COMMIT_IDLE_TICS without another change, unless 'w' or a throw commits
+// them first.
+//
+// consolePoll() does no more than one ring's worth of input per call and only
+// runs a command when the whole reply fits in the transmit ring, so it never
+// waits on the UART. A dump is sent one servo per call as room allows.
+//
+// Needs servo.h and uart.h
+//
+#define CONSOLE_LINE_SIZE	16		// Longest command line
+#define CONSOLE_REPLY_MAX	28		// Longest reply line, "n cur tgt min max speed"
+//
+extern uint16_t consoleCommands;	// Command lines run, including rejected ones
+//
+void consolePoll( void );			// Run any complete command lines received
+//
+// ============================================================================
+//
+#endif	// _CONSOLE_H_
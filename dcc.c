@@ -0,0 +1,191 @@
+//
+// ============================================================================
+//
+// dcc.c -- DCC accessory decoder input for the servoturnout program
+//
+// ============================================================================
+//
+#include <stdint.h>
+//
+#include "hal.h"
+#include "servoturnout.h"
+//
+#include "servo.h"
+#include "dcc.h"
+//
+#ifdef DCC_DECODER
+//
+// Bit assembly states
+enum eDccState { dccPreamble, dccData, dccSeparator };
+//
+// ============================================================================
+//
+uint16_t	dccPackets;
+uint16_t	dccErrors;
+uint16_t	dccOverruns;
+uint16_t	dccCommands;
+//
+// Owned by the ISR
+static uint16_t	dccLastEdge;				// TCNT1 at the last edge
+static uint8_t	dccHalf;					// First half-bit of a pair, 0xFF for none
+static uint8_t	dccState;					// enum eDccState
+static uint8_t	dccCount;					// Preamble 1s, or data bits in dccByte
+static uint8_t	dccByte;
+static uint8_t	dccLen;						// Bytes in dccBuf
+static uint8_t	dccCheck;					// XOR of the bytes so far
+static uint8_t	dccBuf[DCC_PACKET_MAX];
+//
+// Handed to dccPoll(), owned by the ISR while dccReady is 0
+static uint8_t			dccPacket[DCC_PACKET_MAX];
+static uint8_t			dccPacketLen;
+static volatile uint8_t	dccReady;
+//
+// ============================================================================
+// dccInit -- Configure the DCC input pin and its pin change interrupt
+//
+void dccInit( void )
+{
+	DCC_DDR &= ~(1<<DCC_PIN_BIT);
+	DCC_PORT |= (1<<DCC_PIN_BIT);			// Pull-up for the optocoupler
+	dccHalf = 0xFF;
+	dccLastEdge = TCNT1;
+
+	DCC_PCMSK |= (1<<DCC_PIN_BIT);
+	GIMSK |= (1<<DCC_PCIE);
+}
+//
+// ============================================================================
+// dccBit -- Run one bit through the packet state machine
+//
+static void dccBit( uint8_t bit )
+{
+	switch ( dccState ) {
+		case dccPreamble:
+			if ( bit ) {
+				if ( dccCount < 0xFF )
+					++dccCount;
+			}
+			else if ( dccCount >= DCC_PREAMBLE_MIN ) {
+				dccState = dccData;			// Packet start bit
+				dccCount = 0;
+				dccLen = 0;
+				dccCheck = 0;
+			}
+			else {
+				dccCount = 0;
+			}
+			break;
+
+		case dccData:
+			dccByte = (dccByte << 1) | bit;
+			if ( ++dccCount < 8 )
+				break;
+			if ( dccLen >= DCC_PACKET_MAX ) {
+				++dccErrors;
+				dccState = dccPreamble;
+				dccCount = 0;
+				break;
+			}
+			dccBuf[dccLen++] = dccByte;
+			dccCheck ^= dccByte;
+			dccState = dccSeparator;
+			break;
+
+		default:	// dccSeparator
+			if ( !bit ) {
+				dccState = dccData;			// Another byte follows
+				dccCount = 0;
+				break;
+			}
+			// Packet end bit, which may also be the first bit of the next preamble
+			if ( (dccLen < 3) || dccCheck ) {
+				++dccErrors;
+			}
+			else if ( dccReady ) {
+				++dccOverruns;
+			}
+			else {
+				for ( uint8_t n=0; n<dccLen; ++n )
+					dccPacket[n] = dccBuf[n];
+				dccPacketLen = dccLen;
+				dccReady = 1;
+			}
+			dccState = dccPreamble;
+			dccCount = 1;
+			break;
+	}
+}
+//
+// ============================================================================
+// PCINT_A -- Pin change ISR for the DCC input
+//
+// Halves that don't pair up are taken as the first half of a new bit, which
+// is how the decoder finds the bit boundaries. A half-bit outside both ranges
+// starts the preamble search over.
+//
+ISR(PCINT_A_vect)
+{
+	uint16_t	now = TCNT1;
+	uint16_t	half;
+	uint8_t		bit;
+
+	half = now - dccLastEdge;
+	if ( now < dccLastEdge )
+		half += ICR1 + 1;					// Timer1 wrapped at TOP
+	dccLastEdge = now;
+
+	if ( (half >= DCC_COUNTS( DCC_ONE_MIN_US )) && (half <= DCC_COUNTS( DCC_ONE_MAX_US )) ) {
+		bit = 1;
+	}
+	else if ( half >= DCC_COUNTS( DCC_ZERO_MIN_US ) ) {
+		bit = 0;
+	}
+	else {
+		if ( dccState != dccPreamble )
+			++dccErrors;
+		dccHalf = 0xFF;
+		dccState = dccPreamble;
+		dccCount = 0;
+		return;
+	}
+
+	if ( dccHalf != bit ) {
+		dccHalf = bit;						// First half, or out of step
+		return;
+	}
+	dccHalf = 0xFF;
+	dccBit( bit );
+}
+//
+// ============================================================================
+// dccPoll -- Act on a received packet, if any
+//
+// Called on every pass of the main loop. Only basic accessory packets
+// addressed to one of our turnouts do anything.
+//
+void dccPoll( void )
+{
+	uint16_t	turnout;
+	uint8_t		a, b;
+
+	if ( !dccReady )
+		return;
+
+	++dccPackets;
+	a = dccPacket[0];
+	b = dccPacket[1];
+	if ( (3 == dccPacketLen) && (0x80 == (a & 0xC0)) && (0x80 == (b & 0x80)) && (b & 0x08) ) {
+		// Decoder address, 1-511, then 1-based turnout number
+		turnout = ( (a & 0x3F) | ((uint16_t)(~b & 0x70) << 2) );
+		turnout = ( turnout - 1 ) * 4 + ( (b >> 1) & 0x03 ) + 1;
+		turnout -= DCC_FIRST_TURNOUT;
+		if ( (turnout < SERVO_COUNT) && servoSelect( turnout, b & 0x01 ) )
+			++dccCommands;
+	}
+	dccReady = 0;
+}
+//
+#endif	// DCC_DECODER
+//
+// ============================================================================
+//
@@ -0,0 +1,66 @@
+#ifndef _DCC_H_
+#define _DCC_H_
+//
+// ============================================================================
+//
+// dcc.h -- DCC accessory decoder input, build with -DDCC_DECODER
+//
+// ============================================================================
+//
+// The track signal comes in through an optocoupler on PA1 (XTAL2, free when
+// running from the internal oscillator) and the PCINT9 pin change interrupt.
+// Each edge costs one TCNT1 read, a subtraction and a few compares in the
+// ISR: the half-bit since the last edge is classed as a 1 (52-64us nominal)
+// or a 0 (90us or more), two matching halves make a bit, and bits go through
+// a preamble/byte/separator state machine. A packet whose XOR checksum is good
+// is handed to dccPoll() in the main loop, which does the address decoding.
+//
+// Timer1 is used as the time reference, it counts 1us (0.125us with
+// SERVO_HIRES) and wraps at ICR1 whatever mode it is in. A half-bit longer
+// than the timer1 period (only stretched 0s, 5ms with SERVO_HIRES) is read
+// modulo the period, which still reads as a 0 or as an error that the next
+// preamble recovers from. PWM is generated by the hardware, so the edge
+// interrupts never touch the servo pulses. With SERVO_MUX, an edge can hold
+// off a mux compare interrupt for the length of this ISR.
+//
+// A basic accessory packet 10AAAAAA 1aaaCPPD addresses output pair PP of
+// accessory decoder AAAAAA + (~aaa << 6). Turnout T (1-based, as most cabs
+// number them) is pair (T-1)%4 of decoder (T-1)/4+1. Turnouts DCC_FIRST_TURNOUT
+// on drive servo1, servo2 and so on. D=1 sends the servo to maxPos, D=0 to
+// minPos. Only activate packets (C=1) are acted on, and a command for the
+// position the servo is already heading for is ignored, so the repeats a
+// command station sends cost nothing.
+//
+// Needs servoturnout.h
+//
+#ifndef DCC_FIRST_TURNOUT
+#define DCC_FIRST_TURNOUT	1
+#endif
+//
+#define DCC_PORT			PORTA
+#define DCC_DDR				DDRA
+#define DCC_PIN				PINA
+#define DCC_PIN_BIT			PA1
+#define DCC_PCMSK			PCMSK1
+#define DCC_PCIE			PCIE1
+//
+// Half-bit limits, NMRA S-9.1 decoder tolerances
+#define DCC_ONE_MIN_US		52
+#define DCC_ONE_MAX_US		64
+#define DCC_ZERO_MIN_US		90
+#define DCC_PREAMBLE_MIN	10		// 1 bits before the packet start bit
+#define DCC_PACKET_MAX		6		// Bytes, including the checksum
+//
+#define DCC_COUNTS(us)		((uint16_t)((us) * (FCPU / 1000000L) / TIMER1_DIVISOR))
+//
+extern uint16_t	dccPackets;			// Packets with a good checksum
+extern uint16_t	dccErrors;			// Bad half-bits, framing or checksums
+extern uint16_t	dccOverruns;		// Good packets dropped, dccPoll() was behind
+extern uint16_t	dccCommands;		// Accessory packets that moved a servo
+//
+void dccInit( void );				// Configure the input pin and its interrupt
+void dccPoll( void );				// Act on a received packet, if any
+//
+// ============================================================================
+//
+#endif	// _DCC_H_
@@ -0,0 +1,140 @@
+//
+// ============================================================================
+//
+// frog.c -- Frog polarity relays for the servoturnout program
+//
+// ============================================================================
+//
+#include <stdint.h>
+//
+#include "hal.h"
+#include "servoturnout.h"
+//
+#include "servo.h"
+#include "rom.h"
+#include "frog.h"
+//
+#ifdef FROG_RELAY
+//
+#ifdef SERVO_MUX
+#error "SERVO_MUX and FROG_RELAY both need PD4 and PA0"
+#endif
+//
+// ============================================================================
+//
+uint8_t		frogPoint[SERVO_COUNT];
+uint8_t		frogState;
+uint16_t	frogFlips[SERVO_COUNT];
+uint32_t	frogOnTics[SERVO_COUNT];
+uint16_t	frogHeld;
+static uint8_t	frogDwell[SERVO_COUNT];		// Tics in the present state, saturating
+//
+// Coil driver of each servo, a SERVO_PIN()
+static const uint16_t frogPins[SERVO_COUNT] PROGMEM = { FROG1_PIN, FROG2_PIN };
+//
+// ============================================================================
+// frogDrive -- Switch a relay coil on or off
+//
+// The LED slot ISR rewrites PORTD too, so the read-modify-write is atomic.
+//
+static void frogDrive( enum eServo idx, uint8_t on )
+{
+	uint16_t	pin = pgm_read_word( &frogPins[idx] );
+	uint8_t		mask = SERVO_PIN_MASK( pin );
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+		if ( ePORTA == SERVO_PIN_PORT( pin ) ) {
+			if ( on )
+				PORTA |= mask;
+			else
+				PORTA &= ~mask;
+		}
+		else {
+			if ( on )
+				PORTD |= mask;
+			else
+				PORTD &= ~mask;
+		}
+	}
+}
+//
+// ============================================================================
+// frogInit -- Load the switch points and set each relay to match its servo
+//
+// Call after the servo data has been loaded. The coil drivers are outputs from
+// here on, the relays are set before the first move and count as settled.
+//
+void frogInit( void )
+{
+	for ( uint8_t idx=0; idx<SERVO_COUNT; ++idx ) {
+		frogPoint[idx] = romConfigRead( ROM_ADDR_FROG( idx ), FROG_DEFAULT_POINT );
+		if ( servo[idx].targetPos == servo[idx].maxPos )
+			frogState |= 1<<idx;
+		frogDrive( idx, frogState & (1<<idx) );
+		frogDwell[idx] = FROG_DWELL_TICS;
+	}
+	DDRD |= SERVO_PIN_MASK( FROG1_PIN );
+	DDRA |= SERVO_PIN_MASK( FROG2_PIN );
+}
+//
+// ============================================================================
+// frogHeartBeat -- Flip the relays of servos that have passed their switch point
+//
+// Call after servoMove(), so the relay follows the position being sent to the
+// servo this tic. A servo heading for, or resting nearer, maxPos needs the coil
+// on once it is at or past the switch point, one heading for minPos needs it
+// off once it is at or before it. Between the two the relay is left alone.
+//
+void frogHeartBeat( void )
+{
+	const servoData_t * s;
+	uint16_t	at;
+	uint8_t		mask, want;
+
+	for ( uint8_t idx=0; idx<SERVO_COUNT; ++idx ) {
+		s = &servo[idx];
+		mask = 1<<idx;
+		at = s->minPos + ( ((uint32_t)(s->maxPos - s->minPos) * frogPoint[idx]) >> 8 );
+
+		want = frogState & mask;
+		if ( (s->targetPos >= s->currentPos) && (s->currentPos >= at) )
+			want = mask;
+		if ( (s->targetPos <= s->currentPos) && (s->currentPos <= at) )
+			want = 0;
+
+		if ( want != (frogState & mask) ) {
+			if ( frogDwell[idx] < FROG_DWELL_TICS ) {
+				++frogHeld;
+			}
+			else {
+				frogState ^= mask;
+				frogDrive( idx, want );
+				frogDwell[idx] = 0;
+				++frogFlips[idx];
+			}
+		}
+
+		if ( frogDwell[idx] < 0xFF )
+			++frogDwell[idx];
+		if ( frogState & mask )
+			++frogOnTics[idx];
+	}
+}
+//
+// ============================================================================
+// frogSetPoint -- Calibrate a relay's switch point and save it
+//
+// return 0, with nothing changed, if the EEPROM queue hadn't room
+//
+uint8_t frogSetPoint( enum eServo idx, uint8_t point )
+{
+	if ( !romConfigWrite( ROM_ADDR_FROG( idx ), point ) )
+		return 0;
+	frogPoint[idx] = point;
+	return 1;
+}
+//
+#endif	// FROG_RELAY
+//
+// ============================================================================
+//
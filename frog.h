@@ -0,0 +1,60 @@
+#ifndef _FROG_H_
+#define _FROG_H_
+//
+// ============================================================================
+//
+// frog.h -- Frog polarity relays for the servoturnout program, build with
+//			 -DFROG_RELAY
+//
+// ============================================================================
+//
+// Each turnout's frog is fed through an SPDT relay: coil off connects it to the
+// rail that matches the points at minPos, coil on to the one for maxPos. The
+// coil drivers are on the LED2 pin (PD4) for servo1 and XTAL1 (PA0, free when
+// running from the internal oscillator) for servo2, so with FROG_RELAY LED2
+// isn't fitted. SERVO_MUX has servos on those pins.
+//
+// While the points travel, the frog must change over after the closing point
+// has left its stock rail and before the other one arrives, or DCC power is
+// shorted through the wheels on the frog. A servo's relay flips in the tic its
+// currentPos crosses the switch point, frogPoint[idx]/256 of the way from
+// minPos to maxPos, in the direction it is moving. The point is a position, not
+// a time, so a throw reversed halfway, a change of speed or profile, or a
+// limit change all still flip it at the same place on the turnout. The default
+// is the midpoint, each servo can be calibrated to its own linkage with the
+// console 'f' command and the value is kept in the EEPROM board settings.
+//
+// Coil dwell: a relay isn't flipped again until it has been in its present
+// state for FROG_DWELL_TICS, so its contacts have settled and it can't chatter
+// on a servo hunting around the switch point. A flip that has to wait is
+// counted in frogHeld, once per tic. frogOnTics counts the tics each coil has
+// been energized, for the power budget, and frogFlips the operations, for
+// contact wear.
+//
+// Costs one 16x8 multiply and a few compares per servo per tic.
+//
+// Needs servoturnout.h and servo.h
+//
+#define FROG1_PIN			SERVO_PIN( ePORTD, PD4 )	// LED2
+#define FROG2_PIN			SERVO_PIN( ePORTA, PA0 )	// XTAL1
+//
+#ifndef FROG_DEFAULT_POINT
+#define FROG_DEFAULT_POINT	128		// Midpoint, /256 of the way from minPos to maxPos
+#endif
+#ifndef FROG_DWELL_TICS
+#define FROG_DWELL_TICS		3		// 60ms, a small relay operates and settles in ~15ms
+#endif
+//
+extern uint8_t	frogPoint[SERVO_COUNT];		// Switch point of each relay, /256
+extern uint8_t	frogState;					// Bit n set while servo n's coil is on
+extern uint16_t	frogFlips[SERVO_COUNT];		// Relay operations
+extern uint32_t	frogOnTics[SERVO_COUNT];	// Tics each coil has been energized
+extern uint16_t	frogHeld;					// Tics a flip waited for the dwell time
+//
+void frogInit( void );						// Load the switch points, set the relays
+void frogHeartBeat( void );					// Flip relays whose servo passed the switch point
+uint8_t frogSetPoint( enum eServo idx, uint8_t point );	// Calibrate, 0 if the EEPROM queue is full
+//
+// ============================================================================
+//
+#endif	// _FROG_H_
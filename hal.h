@@ -0,0 +1,89 @@
+#ifndef _HAL_H_
+#define _HAL_H_
+//
+// ============================================================================
+//
+// hal.h -- Hardware abstraction layer for the servoturnout program
+//
+// ============================================================================
+//
+// The firmware modules include this header instead of the avr-libc headers.
+// On the target it pulls in the real register definitions and the avr-libc
+// eeprom/pgmspace helpers. When HOST_BUILD is defined the same names resolve
+// to a simulated register file and EEPROM image (see hal_host.h) so the
+// modules can be built, run and timed on a Linux box with 'make host'.
+//
+// halRunning()	-- Non-zero while the main loop should keep running
+// halIdle(pending)	-- Called whenever the main loop is waiting for a timer tic,
+//				   sleeps until the next interrupt unless pending is true
+// halTimer1Count()	-- Timer1 counts since the start of the PWM period, for timing
+// halEepromXxx	-- Byte level EEPROM access that doesn't busy-wait
+// halTimer1Wait(t)	-- Spin until TCNT1 reaches t, for edges too close for an interrupt
+// halBarrier()	-- Compiler memory barrier, orders plain loads and stores against
+//				   the volatile handshakes shared with an interrupt
+//
+// ============================================================================
+//
+#ifdef HOST_BUILD
+//
+#include "hal_host.h"
+//
+#else	// HOST_BUILD
+//
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+//
+#define halRunning()		1		// The target never leaves the main loop
+#define halTimer1Count()	TCNT1
+//
+// Idle sleep keeps the timers and interrupts running. pending is tested with
+// interrupts off, and the instruction after sei() is always executed before a
+// pending interrupt, so an interrupt that makes pending true can't slip in
+// between the test and sleep_cpu() and leave us asleep for a whole tic.
+#define halIdle(pending)	do {							\
+								cli();						\
+								if ( !(pending) ) {			\
+									set_sleep_mode( SLEEP_MODE_IDLE );	\
+									sleep_enable();			\
+									sei();					\
+									sleep_cpu();			\
+									sleep_disable();		\
+								}							\
+								sei();						\
+							} while ( 0 )
+#define halTimer1Wait(t)	do { } while ( (int16_t)(TCNT1 - (t)) < 0 )
+//
+// EEPROM access for the interrupt driven write queue in rom.c. The EEPM bits
+// are left at 00 (atomic erase and write) and EEMPE/EEPE are set with sbi so
+// EEPE follows EEMPE within the required four cycles.
+//
+#define halEepromBusy()			(EECR & (1<<EEPE))
+#define halEepromIntEnable()	(EECR |= (1<<EERIE))
+#define halEepromIntDisable()	(EECR &= ~(1<<EERIE))
+//
+static inline uint8_t halEepromRead( uint8_t addr )
+{
+	EEAR = addr;
+	EECR |= (1<<EERE);
+	return EEDR;
+}
+//
+static inline void halEepromWrite( uint8_t addr, uint8_t data )
+{
+	EEAR = addr;
+	EEDR = data;
+	EECR |= (1<<EEMPE);
+	EECR |= (1<<EEPE);
+}
+//
+#endif	// HOST_BUILD
+//
+#define halBarrier()		__asm__ __volatile__( "" ::: "memory" )
+//
+// ============================================================================
+//
+#endif	// _HAL_H_
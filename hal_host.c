@@ -0,0 +1,624 @@
+//
+// ============================================================================
+//
+// hal_host.c -- Simulated ATtiny4313 for the host (Linux) build
+//
+// ============================================================================
+//
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+//
+#include "hal.h"
+//
+// ============================================================================
+// Simulated register file
+//
+volatile uint8_t	PORTA, DDRA, PINA;
+volatile uint8_t	PORTB, DDRB, PINB;
+volatile uint8_t	PORTD, DDRD, PIND;
+volatile uint8_t	MCUCR, GIMSK, SREG;
+volatile uint8_t	PCMSK, PCMSK1, PCMSK2;
+volatile uint8_t	TIFR, TIMSK;
+volatile uint8_t	TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B;
+volatile uint8_t	TCCR1A, TCCR1B, TCCR1C;
+volatile uint16_t	TCNT1, ICR1, OCR1A, OCR1B;
+volatile uint8_t	EEAR, EEDR, EECR;
+volatile uint8_t	UCSRA, UCSRB, UCSRC, UBRRH, UBRRL;
+volatile uint16_t	UDR;
+volatile uint8_t	USICR, USISR, USIDR;
+//
+volatile uint8_t	simIntEnable;
+//
+// ============================================================================
+// Simulator state
+//
+uint8_t		simEeprom[E2END+1];
+uint32_t	simEepromWrites;
+uint32_t	simEepromBusyUs;
+uint32_t	simTicks;
+uint32_t	simTickLimit;
+uint32_t	simTimer0Counts;
+uint8_t		simRunning = 1;
+void		(*simTickHook)( uint32_t tick );
+uint32_t	simPulseCount[2];
+uint16_t	simPulseWidth[2];
+uint32_t	simPinPulseCount[SIM_PORTS][8];
+uint16_t	simPinPulseWidth[SIM_PORTS][8];
+uint32_t	simPinHighCounts[SIM_PORTS][8];
+uint32_t	simTimer0CompB;
+int			(*simUartIn)( void );
+void		(*simUartOut)( uint8_t c );
+uint8_t		simRealTime;
+int32_t		(*simEdgeIn)( void );
+uint32_t	simEdges;
+uint32_t	simEdgeAt;
+static uint16_t	simUartRxBudget;		// Bytes RXD can still carry this tic
+static uint16_t	simUartTxBudget;		// Bytes TXD can still carry this tic
+static uint8_t	simPinHigh[SIM_PORTS];		// Port state at the last monitor call
+static uint16_t	simPinRise[SIM_PORTS][8];	// TCNT1 when the pin went high
+static uint32_t	simTimer1Periods;		// PWM periods run since reset
+//
+// ============================================================================
+// Default interrupt handlers, overridden by the firmware's ISR() definitions
+//
+__attribute__((weak)) void TIMER0_COMPA_vect( void ) { }
+__attribute__((weak)) void TIMER0_COMPB_vect( void ) { }
+__attribute__((weak)) void TIMER1_OVF_vect( void ) { }
+__attribute__((weak)) void TIMER1_CAPT_vect( void ) { }
+__attribute__((weak)) void TIMER1_COMPA_vect( void ) { }
+__attribute__((weak)) void TIMER1_COMPB_vect( void ) { }
+__attribute__((weak)) void PCINT_A_vect( void ) { }
+__attribute__((weak)) void PCINT_D_vect( void ) { }
+__attribute__((weak)) void EEPROM_READY_vect( void ) { }
+__attribute__((weak)) void USART_RX_vect( void ) { }
+__attribute__((weak)) void USART_UDRE_vect( void ) { }
+__attribute__((weak)) void USI_START_vect( void ) { }
+__attribute__((weak)) void USI_OVERFLOW_vect( void ) { }
+//
+// ============================================================================
+// simReset -- Put the simulated part in its power-on state
+//
+// Inputs float high (pull-ups, nothing pressed) and the EEPROM is erased.
+//
+void simReset( void )
+{
+	PORTA = DDRA = 0;	PINA = 0xFF;
+	PORTB = DDRB = 0;	PINB = 0xFF;
+	PORTD = DDRD = 0;	PIND = 0x7F;
+	MCUCR = GIMSK = SREG = TIFR = TIMSK = 0;
+	PCMSK = PCMSK1 = PCMSK2 = 0;
+	TCCR0A = TCCR0B = TCNT0 = OCR0A = OCR0B = 0;
+	TCCR1A = TCCR1B = TCCR1C = 0;
+	TCNT1 = ICR1 = OCR1A = OCR1B = 0;
+	EEAR = EEDR = EECR = 0;
+	UCSRA = (1<<UDRE);
+	UCSRB = UCSRC = UBRRH = UBRRL = 0;
+	UDR = 0;
+	USICR = USISR = USIDR = 0;
+	simIntEnable = 0;
+
+	memset( simEeprom, 0xFF, sizeof(simEeprom) );
+	simEepromWrites = 0;
+	simEepromBusyUs = 0;
+	simTicks = 0;
+	simTimer0Counts = 0;
+	simRunning = 1;
+	simPulseCount[0] = simPulseCount[1] = 0;
+	simPulseWidth[0] = simPulseWidth[1] = 0;
+	memset( simPinPulseCount, 0, sizeof(simPinPulseCount) );
+	memset( simPinPulseWidth, 0, sizeof(simPinPulseWidth) );
+	memset( simPinHighCounts, 0, sizeof(simPinHighCounts) );
+	simTimer0CompB = 0;
+	simEdges = simEdgeAt = 0;
+	memset( simPinHigh, 0, sizeof(simPinHigh) );
+	simTimer1Periods = 0;
+}
+//
+// ============================================================================
+// simEepromLoad/simEepromSave -- Keep the EEPROM image in a file between runs
+//
+// Return 0 on success, -1 if the file can't be opened or is the wrong size
+//
+int simEepromLoad( const char * path )
+{
+	FILE * fp = fopen( path, "rb" );
+	size_t len;
+
+	if ( NULL == fp )
+		return -1;
+	len = fread( simEeprom, 1, sizeof(simEeprom), fp );
+	fclose( fp );
+
+	return ( len == sizeof(simEeprom) ) ? 0 : -1;
+}
+
+int simEepromSave( const char * path )
+{
+	FILE * fp = fopen( path, "wb" );
+	size_t len;
+
+	if ( NULL == fp )
+		return -1;
+	len = fwrite( simEeprom, 1, sizeof(simEeprom), fp );
+	fclose( fp );
+
+	return ( len == sizeof(simEeprom) ) ? 0 : -1;
+}
+//
+// ============================================================================
+// eeprom_xxx -- avr-libc EEPROM API on top of the image
+//
+// The firmware passes EEPROM byte addresses disguised as pointers.
+//
+uint8_t eeprom_read_byte( const uint8_t * addr )
+{
+	return simEeprom[ (uintptr_t)addr & E2END ];
+}
+
+uint16_t eeprom_read_word( const uint16_t * addr )
+{
+	uintptr_t a = (uintptr_t)addr;
+
+	return simEeprom[ a & E2END ] | (simEeprom[ (a+1) & E2END ] << 8);
+}
+
+void eeprom_update_byte( uint8_t * addr, uint8_t value )
+{
+	uintptr_t a = (uintptr_t)addr & E2END;
+
+	if ( simEeprom[a] != value ) {
+		simEeprom[a] = value;
+		++simEepromWrites;
+	}
+}
+
+void eeprom_update_word( uint16_t * addr, uint16_t value )
+{
+	uintptr_t a = (uintptr_t)addr;
+
+	eeprom_update_byte( (uint8_t *)a, value & 0xFF );
+	eeprom_update_byte( (uint8_t *)(a+1), value >> 8 );
+}
+
+void eeprom_read_block( void * dst, const void * src, size_t len )
+{
+	uintptr_t a = (uintptr_t)src;
+	uint8_t * d = dst;
+
+	while ( len-- )
+		*d++ = simEeprom[ a++ & E2END ];
+}
+
+void eeprom_update_block( const void * src, void * dst, size_t len )
+{
+	uintptr_t a = (uintptr_t)dst;
+	const uint8_t * s = src;
+
+	while ( len-- )
+		eeprom_update_byte( (uint8_t *)a++, *s++ );
+}
+//
+// ============================================================================
+// halEepromRead/halEepromWrite -- Byte level access used by the rom.c write queue
+//
+uint8_t halEepromRead( uint8_t addr )
+{
+	EEAR = addr;
+	EEDR = simEeprom[addr];
+	return EEDR;
+}
+
+void halEepromWrite( uint8_t addr, uint8_t data )
+{
+	EEAR = addr;
+	EEDR = data;
+	simEeprom[addr] = data;
+	++simEepromWrites;
+	simEepromBusyUs = SIM_EEPROM_WRITE_US;
+}
+//
+// ============================================================================
+// simIsr -- Dispatch an interrupt handler if interrupts are enabled
+//
+static void simIsr( uint8_t enabled, void (*handler)( void ) )
+{
+	if ( simIntEnable && enabled ) {
+		simIntEnable = 0;				// Hardware clears I while in the ISR
+		handler();
+		simIntEnable = 1;
+	}
+}
+//
+// ============================================================================
+// simEepromRun -- Run the EEPROM for one heartbeat period
+//
+// Finish the write in progress and fire EEPROM_READY_vect whenever the EEPROM
+// is idle with EERIE set, for as many writes as fit in the period.
+//
+static void simEepromRun( void )
+{
+	uint32_t budget = 1000000UL / SIM_HEARTBEAT_HZ;
+
+	while ( budget ) {
+		if ( simEepromBusyUs ) {
+			if ( simEepromBusyUs >= budget ) {
+				simEepromBusyUs -= budget;
+				break;
+			}
+			budget -= simEepromBusyUs;
+			simEepromBusyUs = 0;
+		}
+		if ( !simIntEnable || !(EECR & (1<<EERIE)) )
+			break;
+		simIsr( 1, EEPROM_READY_vect );
+	}
+}
+//
+// ============================================================================
+// simPinMonitor -- Time GPIO pulses against TCNT1
+//
+// Called after each timer1 ISR in CTC mode. A rising edge notes TCNT1, a falling
+// edge records the pulse width.
+//
+static void simPinMonitor( void )
+{
+	uint8_t		now[SIM_PORTS] = { PORTA, PORTB, PORTD };
+	uint8_t		changed;
+
+	for ( uint8_t port=0; port<SIM_PORTS; ++port ) {
+		changed = now[port] ^ simPinHigh[port];
+		for ( uint8_t bit=0; bit<8; ++bit ) {
+			if ( !(changed & (1<<bit)) )
+				continue;
+			if ( now[port] & (1<<bit) ) {
+				simPinRise[port][bit] = TCNT1;
+			}
+			else {
+				++simPinPulseCount[port][bit];
+				simPinPulseWidth[port][bit] = TCNT1 - simPinRise[port][bit];
+			}
+		}
+		simPinHigh[port] = now[port];
+	}
+}
+//
+// ============================================================================
+// simTimer1Run -- Run timer1 for one heartbeat period
+//
+// Fast PWM mode 14, each PWM period: at BOTTOM a connected OC1x pin goes high
+// with the OCR1x value latched, then the TOV1 interrupt raised at the previous
+// TOP is serviced, and the pin falls at the compare match (COMPA/COMPB
+// interrupts). A pulse is counted if the pin was high at BOTTOM and is still
+// connected when it falls.
+//
+// CTC mode 12, each period: the capture interrupt raised at the previous TOP is
+// serviced at BOTTOM, then the compare A interrupt fires each time TCNT1 reaches
+// OCR1A. An OCR1A the counter has already passed doesn't match until the next
+// period, as on the real part. GPIO pulses are timed by simPinMonitor().
+//
+static void simTimer1Run( void )
+{
+	static const uint16_t prescale[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+	uint16_t	div = prescale[ TCCR1B & 7 ];
+	uint32_t	periods;
+	uint16_t	ocr[2];
+	uint8_t		high[2];
+	uint8_t		ctc;
+
+	if ( 0 == div )
+		return;
+
+	ctc = !(TCCR1A & (1<<WGM11));
+	periods = SIM_FCPU / SIM_HEARTBEAT_HZ / div / ((uint32_t)ICR1 + 1);
+	while ( periods-- ) {
+		if ( ctc ) {
+			TCNT1 = 0;
+			if ( simTimer1Periods++ )
+				simIsr( TIMSK & (1<<ICIE1), TIMER1_CAPT_vect );
+			simPinMonitor();
+			for ( uint8_t n=0; (n < 32) && (TIMSK & (1<<OCIE1A)) && (OCR1A > TCNT1) && (OCR1A <= ICR1); ++n ) {
+				TCNT1 = OCR1A;
+				simIsr( 1, TIMER1_COMPA_vect );
+				simPinMonitor();
+			}
+			continue;
+		}
+
+		ocr[0] = OCR1A;
+		ocr[1] = OCR1B;
+		high[0] = ( TCCR1A & (1<<COM1A1) ) != 0;
+		high[1] = ( TCCR1A & (1<<COM1B1) ) != 0;
+
+		if ( simTimer1Periods++ )
+			simIsr( TIMSK & (1<<TOIE1), TIMER1_OVF_vect );
+
+		for ( uint8_t ch=0; ch<2; ++ch ) {
+			if ( high[ch] && (TCCR1A & (1<<(ch ? COM1B1 : COM1A1))) ) {
+				++simPulseCount[ch];
+				simPulseWidth[ch] = ocr[ch];
+			}
+			simIsr( TIMSK & (1<<(ch ? OCIE1B : OCIE1A)), ch ? TIMER1_COMPB_vect : TIMER1_COMPA_vect );
+		}
+	}
+}
+//
+// ============================================================================
+// simPinHighRun -- Add a span of timer0 counts to each high pin's total
+//
+static void simPinHighRun( uint8_t counts )
+{
+	uint8_t		now[SIM_PORTS] = { PORTA, PORTB, PORTD };
+
+	for ( uint8_t port=0; port<SIM_PORTS; ++port ) {
+		for ( uint8_t bit=0; bit<8; ++bit ) {
+			if ( now[port] & (1<<bit) )
+				simPinHighCounts[port][bit] += counts;
+		}
+	}
+}
+//
+// ============================================================================
+// simTimer0Run -- Run timer0 for one heartbeat period, up to its compare A match
+//
+// The compare B interrupt fires each time TCNT0 reaches OCR0B. An OCR0B the
+// counter has already passed, or one beyond OCR0A, doesn't match in this
+// period. simPinHighCounts[] accumulates how long each pin was high, in timer0
+// counts. TCNT0 is left at 0, where the firmware sees it between tics.
+//
+static void simTimer0Run( void )
+{
+	uint16_t	t = 0;
+
+	for ( uint8_t n=0; (n < 64) && (TIMSK & (1<<OCIE0B)) && (OCR0B >= t) && (OCR0B <= OCR0A); ++n ) {
+		simPinHighRun( OCR0B - TCNT0 );
+		TCNT0 = OCR0B;
+		t = TCNT0 + 1;
+		++simTimer0CompB;
+		simIsr( 1, TIMER0_COMPB_vect );
+	}
+	simPinHighRun( OCR0A + 1 - TCNT0 );
+	TCNT0 = 0;
+}
+//
+// ============================================================================
+// simUartBytesPerTic -- Bytes the USART can move each way in one heartbeat
+//
+// 10 bits per byte for 8N1 at the baud rate set by UBRR and U2X.
+//
+static uint16_t simUartBytesPerTic( void )
+{
+	uint32_t baud = SIM_FCPU / (((UCSRA & (1<<U2X)) ? 8UL : 16UL) * (((uint32_t)UBRRH << 8 | UBRRL) + 1));
+
+	return baud / 10 / SIM_HEARTBEAT_HZ;
+}
+//
+// ============================================================================
+// simUartRun -- Move bytes through the USART
+//
+// The data register empty interrupt fires while UDRIE is set, each byte it
+// writes to UDR is passed to simUartOut. Up to SIM_UART_BURST received bytes
+// are then delivered through the receive interrupt. A received byte wakes the
+// CPU from idle sleep, so simIdle() returns to the firmware after them rather
+// than running the rest of the tic. Each direction is limited to the bytes
+// the baud rate allows per tic.
+//
+// return non-zero if any bytes were received
+//
+static uint8_t simUartRun( void )
+{
+	uint8_t		n = 0;
+	int			c;
+
+	while ( simUartTxBudget && (UCSRB & (1<<TXEN)) && (UCSRB & (1<<UDRIE)) && simIntEnable ) {
+		UDR = 0x100;
+		simIsr( 1, USART_UDRE_vect );
+		if ( UDR > 0xFF )
+			break;						// Nothing to send, UDRIE was cleared
+		if ( simUartOut )
+			simUartOut( UDR );
+		--simUartTxBudget;
+	}
+
+	while ( (n < SIM_UART_BURST) && simUartRxBudget && simUartIn && (UCSRB & (1<<RXEN)) ) {
+		if ( (c = simUartIn()) < 0 )
+			break;
+		UDR = c;
+		simIsr( UCSRB & (1<<RXCIE), USART_RX_vect );
+		--simUartRxBudget;
+		++n;
+	}
+	return n;
+}
+//
+// ============================================================================
+// simEdgeRun -- Make the next PA1 edges that fall in this tic
+//
+// Each edge toggles PINA, sets TCNT1 to what timer1 would read at that moment
+// and fires the port A pin change interrupt if it is enabled for PA1. As on
+// the part, the interrupt wakes the CPU, so simIdle() returns to the firmware
+// after every SIM_EDGE_BURST edges rather than running the rest of the tic.
+//
+// return non-zero if any edges were made
+//
+static uint8_t simEdgeRun( void )
+{
+	static const uint16_t prescale[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+	uint16_t		div = prescale[ TCCR1B & 7 ];
+	uint64_t		us;
+	int32_t			next;
+	uint8_t			n;
+
+	for ( n=0; (n < SIM_EDGE_BURST) && simEdgeIn && (simEdgeAt < SIM_TIC_US); ++n ) {
+		PINA ^= (1<<PA1);
+		us = (uint64_t)simTicks * SIM_TIC_US + simEdgeAt;
+		if ( div )
+			TCNT1 = us * (SIM_FCPU / 1000000) / div % ((uint32_t)ICR1 + 1);
+		++simEdges;
+		simIsr( (GIMSK & (1<<PCIE1)) && (PCMSK1 & (1<<PA1)), PCINT_A_vect );
+
+		if ( (next = simEdgeIn()) < 0 )
+			simEdgeIn = NULL;
+		else
+			simEdgeAt += next;
+	}
+	return n;
+}
+//
+// ============================================================================
+// simTimer1Count -- Stand-in for TCNT1 when timing firmware code
+//
+// Simulated time doesn't pass while the firmware runs, so host wall clock time
+// is converted to timer1 counts instead. The result is modulo ICR1+1 like TCNT1,
+// measurements made with it are of the host CPU, not the AVR.
+//
+uint16_t simTimer1Count( void )
+{
+	static const uint16_t prescale[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+	uint16_t	div = prescale[ TCCR1B & 7 ];
+	struct timespec ts;
+	uint64_t	counts;
+
+	if ( 0 == div )
+		return 0;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	counts = ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec) * (SIM_FCPU / 1000000) / 1000 / div;
+	return counts % ((uint32_t)ICR1 + 1);
+}
+//
+// ============================================================================
+// simTwiStart/simTwiStop -- Bus conditions, the master pulls SDA then SCL low
+//
+static void simTwiStart( void )
+{
+	PINB &= ~((1<<PB5) | (1<<PB7));
+	USISR |= (1<<USISIF);
+	simIsr( USICR & (1<<USISIE), USI_START_vect );
+}
+//
+static void simTwiStop( void )
+{
+	PINB |= (1<<PB5) | (1<<PB7);
+	USISR |= (1<<USIPF);
+}
+//
+// ============================================================================
+// simTwiShift -- Clock the USI until its 4 bit counter overflows
+//
+// The counter counts both SCL edges, so it shifts (16 - USICNT)/2 bits. SDA is
+// the wired AND of the master's bits and USIDR's, if the slave is driving it.
+// A slave that isn't taking part doesn't hold SCL, so the bits go by it.
+//
+// return the bits seen on SDA, MSB first
+//
+static uint8_t simTwiShift( uint8_t master )
+{
+	uint8_t bits = ( 16 - (USISR & 0x0F) ) / 2;
+	uint8_t line = master;
+
+	if ( !(USICR & (1<<USIOIE)) )
+		return line;
+
+	if ( DDRB & (1<<PB5) )
+		line &= USIDR;
+	USIDR = ( 8 == bits ) ? line : (uint8_t)( (USIDR << bits) | (line >> (8 - bits)) );
+	USISR = ( USISR & 0xF0 ) | (1<<USIOIF);
+	simIsr( 1, USI_OVERFLOW_vect );
+	return line;
+}
+//
+// ============================================================================
+// simTwiWrite/simTwiRead -- One transaction with the slave at addr
+//
+// An ACK is SDA low, the master releases SDA (0x80) to read one.
+//
+int simTwiWrite( uint8_t addr, const uint8_t * data, uint8_t len )
+{
+	int n = -1;
+
+	simTwiStart();
+	simTwiShift( addr << 1 );
+	if ( !(simTwiShift( 0x80 ) & 0x80) ) {
+		for ( n=0; n<len; ++n ) {
+			simTwiShift( data[n] );
+			if ( simTwiShift( 0x80 ) & 0x80 )
+				break;
+		}
+	}
+	simTwiStop();
+	return n;
+}
+//
+int simTwiRead( uint8_t addr, uint8_t * data, uint8_t len )
+{
+	int n = -1;
+
+	simTwiStart();
+	simTwiShift( (addr << 1) | 1 );
+	if ( !(simTwiShift( 0x80 ) & 0x80) ) {
+		for ( n=0; n<len; ++n ) {
+			data[n] = simTwiShift( 0xFF );
+			simTwiShift( (n == len-1) ? 0x80 : 0x00 );	// NACK the last byte
+		}
+	}
+	simTwiStop();
+	return n;
+}
+//
+// ============================================================================
+// simIdle -- Advance simulated time to the next heartbeat interrupt
+//
+// Called by the firmware whenever it is waiting for a heartbeat. Runs the tick
+// hook and the port D pin change interrupt if it changed an input, so inputs
+// change at the start of the period whichever timer raises the heartbeat, then
+// the other simulated peripherals for one heartbeat period, fires the timer0 compare interrupt if the firmware enabled it, and
+// stops the main loop once simTickLimit tics have elapsed. Returns early, without a tic, when the USART
+// has received bytes or there were PA1 edges left in the tic. With simRealTime set the tics are paced by the wall
+// clock, for talking to the console over a pseudo-terminal.
+//
+void simIdle( void )
+{
+	if ( simTickLimit && (simTicks >= simTickLimit) ) {
+		simRunning = 0;
+		return;
+	}
+	if ( simUartRun() )
+		return;							// Woken by the receive interrupt
+	if ( simEdgeRun() )
+		return;							// Woken by the PA1 pin change interrupt
+
+	if ( simTickHook ) {
+		uint8_t pind = PIND;
+
+		simTickHook( simTicks );
+		simIsr( (GIMSK & (1<<PCIE2)) && ((pind ^ PIND) & PCMSK2), PCINT_D_vect );
+	}
+
+	simEepromRun();
+	simTimer1Run();
+	simTimer0Run();
+	if ( simEdgeAt >= SIM_TIC_US )
+		simEdgeAt -= SIM_TIC_US;		// Next edge falls in the next tic
+	++simTicks;
+
+	simTimer0Counts += OCR0A + 1;		// The CTC period that just ended
+	simIsr( TIMSK & (1<<OCIE0A), TIMER0_COMPA_vect );
+	simUartRxBudget = simUartTxBudget = simUartBytesPerTic();
+
+	if ( simRealTime ) {
+		static struct timespec start;
+		struct timespec due;
+		uint64_t ns;
+
+		if ( 1 == simTicks )
+			clock_gettime( CLOCK_MONOTONIC, &start );
+		ns = (uint64_t)start.tv_nsec + (uint64_t)simTicks * (1000000000ULL / SIM_HEARTBEAT_HZ);
+		due.tv_sec = start.tv_sec + ns / 1000000000ULL;
+		due.tv_nsec = ns % 1000000000ULL;
+		clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL );
+	}
+}
+//
+// ============================================================================
+//
@@ -0,0 +1,281 @@
+#ifndef _HAL_HOST_H_
+#define _HAL_HOST_H_
+//
+// ============================================================================
+//
+// hal_host.h -- Simulated ATtiny4313 for the host (Linux) build
+//
+// ============================================================================
+//
+// Provides just enough of <avr/io.h>, <avr/interrupt.h>, <avr/pgmspace.h> and
+// <avr/eeprom.h> for the firmware modules to compile unchanged. I/O registers
+// are plain variables in a simulated register file, the EEPROM is a 256 byte
+// image in RAM, and ISR() bodies become ordinary functions that the simulator
+// (hal_host.c) calls when the matching interrupt would fire.
+//
+// ============================================================================
+//
+#include <stddef.h>
+#include <stdint.h>
+//
+// ============================================================================
+// Simulated register file
+//
+extern volatile uint8_t		PORTA, DDRA, PINA;
+extern volatile uint8_t		PORTB, DDRB, PINB;
+extern volatile uint8_t		PORTD, DDRD, PIND;
+extern volatile uint8_t		MCUCR, GIMSK, SREG;
+extern volatile uint8_t		PCMSK, PCMSK1, PCMSK2;
+extern volatile uint8_t		TIFR, TIMSK;
+extern volatile uint8_t		TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B;
+extern volatile uint8_t		TCCR1A, TCCR1B, TCCR1C;
+extern volatile uint16_t	TCNT1, ICR1, OCR1A, OCR1B;
+extern volatile uint8_t		EEAR, EEDR, EECR;
+extern volatile uint8_t		UCSRA, UCSRB, UCSRC, UBRRH, UBRRL;
+extern volatile uint16_t	UDR;	// 16 bits so the simulator can tell if it was written
+extern volatile uint8_t		USICR, USISR, USIDR;
+//
+// ============================================================================
+// Register bit numbers, ATtiny4313
+//
+#define PA0		0
+#define PA1		1
+#define PA2		2
+//
+#define PB0		0
+#define PB1		1
+#define PB2		2
+#define PB3		3
+#define PB4		4
+#define PB5		5
+#define PB6		6
+#define PB7		7
+//
+#define PD0		0
+#define PD1		1
+#define PD2		2
+#define PD3		3
+#define PD4		4
+#define PD5		5
+#define PD6		6
+//
+// GIMSK
+#define PCIE1	3
+#define PCIE2	4
+#define PCIE0	5
+//
+// TIMSK / TIFR
+#define OCIE0A	0
+#define TOIE0	1
+#define OCIE0B	2
+#define ICIE1	3
+#define OCIE1B	5
+#define OCIE1A	6
+#define TOIE1	7
+//
+#define OCF0A	0
+#define TOV0	1
+#define OCF0B	2
+#define ICF1	3
+#define OCF1B	5
+#define OCF1A	6
+#define TOV1	7
+//
+// TCCR0A / TCCR0B
+#define WGM00	0
+#define WGM01	1
+#define COM0B0	4
+#define COM0B1	5
+#define COM0A0	6
+#define COM0A1	7
+#define CS00	0
+#define CS01	1
+#define CS02	2
+#define WGM02	3
+//
+// TCCR1A / TCCR1B
+#define WGM10	0
+#define WGM11	1
+#define COM1B0	4
+#define COM1B1	5
+#define COM1A0	6
+#define COM1A1	7
+#define CS10	0
+#define CS11	1
+#define CS12	2
+#define WGM12	3
+#define WGM13	4
+//
+// EECR
+#define EERE	0
+#define EEPE	1
+#define EEMPE	2
+#define EERIE	3
+#define EEPM0	4
+#define EEPM1	5
+//
+// UCSRA / UCSRB / UCSRC
+#define MPCM	0
+#define U2X		1
+#define UPE		2
+#define DOR		3
+#define FE		4
+#define UDRE	5
+#define TXC		6
+#define RXC		7
+#define TXB8	0
+#define RXB8	1
+#define UCSZ2	2
+#define TXEN	3
+#define RXEN	4
+#define UDRIE	5
+#define TXCIE	6
+#define RXCIE	7
+#define UCPOL	0
+#define UCSZ0	1
+#define UCSZ1	2
+#define USBS	3
+#define UPM0	4
+#define UPM1	5
+//
+// USICR / USISR
+#define USITC	0
+#define USICLK	1
+#define USICS0	2
+#define USICS1	3
+#define USIWM0	4
+#define USIWM1	5
+#define USIOIE	6
+#define USISIE	7
+#define USICNT0	0
+#define USIDC	4
+#define USIPF	5
+#define USIOIF	6
+#define USISIF	7
+//
+// ============================================================================
+// <avr/interrupt.h>
+//
+// The global interrupt flag lives in simIntEnable rather than SREG so the
+// simulator can tell at a glance whether an ISR may be dispatched.
+//
+extern volatile uint8_t simIntEnable;
+//
+#define sei()			(simIntEnable = 1)
+#define cli()			(simIntEnable = 0)
+#define ISR(vector)		void vector( void )
+//
+// Interrupt vectors used by the firmware. The simulator provides weak empty
+// handlers for every vector so a module only needs to define the ones it uses.
+void TIMER0_COMPA_vect( void );
+void TIMER0_COMPB_vect( void );
+void TIMER1_OVF_vect( void );
+void TIMER1_CAPT_vect( void );
+void TIMER1_COMPA_vect( void );
+void TIMER1_COMPB_vect( void );
+void PCINT_A_vect( void );
+void PCINT_D_vect( void );
+void EEPROM_READY_vect( void );
+void USART_RX_vect( void );
+void USART_UDRE_vect( void );
+void USI_START_vect( void );
+void USI_OVERFLOW_vect( void );
+//
+// <util/atomic.h>, only the ATOMIC_RESTORESTATE flavour. Don't 'break' out.
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_BLOCK(type)	for ( uint8_t _sreg = simIntEnable, _once = (simIntEnable = 0, 1); \
+								_once; _once = 0, simIntEnable = _sreg )
+//
+// ============================================================================
+// <avr/pgmspace.h>
+//
+#define PROGMEM
+#define pgm_read_byte(addr)		(*(const uint8_t *)(addr))
+#define pgm_read_word(addr)		(*(const uint16_t *)(addr))
+#define pgm_read_ptr(addr)		(*(void * const *)(addr))
+#define PSTR(s)					(s)
+//
+// ============================================================================
+// <avr/eeprom.h>
+//
+#define E2END				255
+//
+uint8_t eeprom_read_byte( const uint8_t * addr );
+uint16_t eeprom_read_word( const uint16_t * addr );
+void eeprom_update_byte( uint8_t * addr, uint8_t value );
+void eeprom_update_word( uint16_t * addr, uint16_t value );
+void eeprom_read_block( void * dst, const void * src, size_t len );
+void eeprom_update_block( const void * src, void * dst, size_t len );
+//
+// hal.h byte level EEPROM access. A write keeps the simulated EEPROM busy for
+// SIM_EEPROM_WRITE_US, EEPROM_READY_vect fires once it is idle with EERIE set.
+#define SIM_EEPROM_WRITE_US		3400
+//
+#define halEepromBusy()			(simEepromBusyUs != 0)
+#define halEepromIntEnable()	(EECR |= (1<<EERIE))
+#define halEepromIntDisable()	(EECR &= ~(1<<EERIE))
+uint8_t halEepromRead( uint8_t addr );
+void halEepromWrite( uint8_t addr, uint8_t data );
+//
+// ============================================================================
+// Simulator control
+//
+#define SIM_HEARTBEAT_HZ	50			// simIdle() advances time in steps of one heartbeat
+#define SIM_FCPU			8000000UL
+#define SIM_TIC_US			(1000000UL / SIM_HEARTBEAT_HZ)
+#define SIM_UART_BURST		4			// Bytes received per wake from idle
+#define SIM_EDGE_BURST		1			// PA1 edges per wake from idle
+//
+extern uint8_t		simEeprom[E2END+1];	// The EEPROM image
+extern uint32_t		simEepromWrites;	// Count of EEPROM bytes actually written
+extern uint32_t		simEepromBusyUs;	// Time left on the EEPROM write in progress
+extern uint32_t		simTicks;			// Number of heartbeat tics simulated so far
+extern uint32_t		simTickLimit;		// Stop the main loop after this many tics, 0=never
+extern uint32_t		simTimer0Counts;	// Timer0 counts in the heartbeat periods so far
+extern uint8_t		simRunning;			// Cleared when simTickLimit is reached
+extern void			(*simTickHook)( uint32_t tick );	// Called before each tic interrupt
+//
+// Timer1 output monitor, index 0 is OC1A, 1 is OC1B
+extern uint32_t		simPulseCount[2];	// Pulses seen on the pin
+extern uint16_t		simPulseWidth[2];	// Width of the last pulse in timer1 counts
+//
+// GPIO pulse monitor for timer1 CTC mode 12, indexed by SIM_PORTx and bit
+enum { SIM_PORTA, SIM_PORTB, SIM_PORTD, SIM_PORTS };
+extern uint32_t		simPinPulseCount[SIM_PORTS][8];	// Pulses seen on the pin
+extern uint16_t		simPinPulseWidth[SIM_PORTS][8];	// Width of the last pulse in timer1 counts
+extern uint32_t		simPinHighCounts[SIM_PORTS][8];	// Timer0 counts the pin has been high
+extern uint32_t		simTimer0CompB;					// Timer0 compare B interrupts fired
+//
+// USART, at the rate set by UBRR. simUartIn returns the next byte for RXD or
+// -1 if there is none yet, simUartOut takes each byte sent on TXD.
+extern int			(*simUartIn)( void );
+extern void			(*simUartOut)( uint8_t c );
+extern uint8_t		simRealTime;		// Run the tics at SIM_HEARTBEAT_HZ of wall clock time
+//
+// PA1 input. simEdgeIn returns the time in us from the edge just made to the
+// next one, or -1 to stop. simEdges counts the edges made.
+extern int32_t		(*simEdgeIn)( void );
+extern uint32_t		simEdges;
+extern uint32_t		simEdgeAt;			// us into this tic of the next edge
+//
+// TWI master on PB5/PB7, at the byte level: each call clocks a whole
+// transaction through the USI from start to stop. Return the data bytes the
+// slave acknowledged (written) or the bytes read, -1 if the address wasn't.
+int simTwiWrite( uint8_t addr, const uint8_t * data, uint8_t len );
+int simTwiRead( uint8_t addr, uint8_t * data, uint8_t len );
+//
+void simReset( void );					// Reset registers and EEPROM to the erased state
+int simEepromLoad( const char * path );	// Load the EEPROM image from a file
+int simEepromSave( const char * path );	// Save the EEPROM image to a file
+void simIdle( void );					// Advance simulated time to the next heartbeat
+uint16_t simTimer1Count( void );		// Host time since reset in timer1 counts, modulo ICR1+1
+//
+#define halRunning()		(simRunning)
+#define halIdle(pending)	simIdle()
+#define halTimer1Count()	simTimer1Count()
+// Simulated time doesn't advance inside an ISR, waiting for TCNT1 jumps it instead
+#define halTimer1Wait(t)	do { if ( (int16_t)(TCNT1 - (t)) < 0 ) TCNT1 = (t); } while ( 0 )
+//
+// ============================================================================
+//
+#endif	// _HAL_HOST_H_
@@ -0,0 +1,1082 @@
+//
+// ============================================================================
+//
+// host.c -- Host (Linux) driver for the servoturnout simulator
+//
+// ============================================================================
+//
+// Runs the unmodified firmware main loop against the simulated part in
+// hal_host.c, or times the per-tic subsystem functions.
+//
+// Usage: servoturnout-host [-n tics] [-e eeprom.bin] [-p presses] [-s tics] [-u file] [-t] [-d file] [-i file] [-f pct] [-b] [-m] [-q]
+//	-n tics		Number of heartbeat tics to simulate (default 3000, one minute)
+//	-e file		Load the EEPROM image from file and save it back on exit
+//	-p presses	Press BTNPLUS this many times right after the first BTS1 flip
+//	-s tics		Stall the main loop for this many extra tics at tic HOST_STALL_AT
+//	-u file		With UART_CONSOLE, send file to RXD and copy TXD to stdout
+//	-t			With UART_CONSOLE, connect the USART to a pseudo-terminal and run in
+//				real time, eg 'screen /dev/pts/N' to the name printed at startup
+//	-d file		With DCC_DECODER, replay a DCC stream on PA1. One item per line:
+//				  A t d		accessory command for turnout t, direction d, sent 4 times
+//				  P xx ...	a packet, hex bytes including the checksum
+//				  W ms		idle packets for ms milliseconds
+//				  n ...		recorded half-bit times in us
+//				  # ...		comment
+//	-i file		With TWI_SLAVE, run I2C transactions from file, one line per tic:
+//				  W a r xx ...	write bytes from register r of the slave at a
+//				  R a r n		set the pointer to r and read n bytes
+//				  D n			wait n tics
+//				  # ...			comment
+//				All numbers in hex except n. Results are printed as they happen.
+//	-f pct		With FROG_RELAY, set every frog relay switch point to pct percent
+//				of the throw, as the console 'f' command would
+//	-b			Benchmark servoMove(), btnHeartBeat() and the LED engine instead of
+//				running main (and the SERVO_MUX schedule and ISRs)
+//	-m			Check that every motion profile lands exactly on targetPos, and
+//				on time with a throw time, instead of running main. Exits 1 if
+//				any move failed
+//	-q			Don't print the final servo state
+//
+// While running main, BTS1 and BTS2 are flipped on a fixed schedule so the
+// servos have something to do. With SERVO_MUX the servos without a button are
+// toggled in turn as well.
+//
+// ============================================================================
+//
+#define _GNU_SOURCE				// posix_openpt() and friends
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+//
+#include "hal.h"
+#include "servoturnout.h"
+#include "servo.h"
+#include "motion.h"
+#include "button.h"
+#include "led.h"
+#include "rom.h"
+#include "servomux.h"
+#include "timebase.h"
+#include "uart.h"
+#include "console.h"
+#include "dcc.h"
+#include "twi.h"
+#include "frog.h"
+#include "sched.h"
+//
+int firmwareMain( void );		// servoturnout.c main(), renamed by the Makefile
+//
+#define HOST_BTS1_PERIOD	250	// Tics between BTS1 flips
+#define HOST_BTS2_PERIOD	410	// Tics between BTS2 flips
+#define HOST_PRESS_START	(HOST_BTS1_PERIOD+10)	// First BTNPLUS press
+#define HOST_PRESS_PERIOD	10	// Tics per BTNPLUS press and release
+#define HOST_MUX_PERIOD		330	// Tics between toggles of the servos without buttons
+#define HOST_STALL_AT		1000	// Tic at which -s stalls the main loop
+#define HOST_HOLD_MA		80	// Typical micro servo current while pulsed and pushing on a rail
+//
+static uint32_t hostPresses;	// Number of BTNPLUS presses to make
+static uint32_t hostStall;		// Heartbeats raised while the main loop is stalled
+static uint32_t hostFlipTick;	// Tic BTS1 was last flipped, 0 once servo1 has responded
+static uint16_t hostTarget;		// servo1 targetPos at the previous tic
+static uint32_t hostLatencyTics;	// Sum of BTS1 flip to servo1 target change times
+static uint32_t hostLatencyCount;
+#ifdef UART_CONSOLE
+static char * hostUartData;		// -u input
+static size_t hostUartLen;
+static size_t hostUartPos;
+static uint8_t hostUartLine;	// Bytes sent of the current -u line
+static uint8_t hostUartWait;	// Waiting for the reply to a -u line
+static char hostUartTail[3];	// Last bytes seen on TXD
+static uint32_t hostUartDone;	// Tic the last reply byte was sent
+static int hostPty = -1;		// -t pseudo-terminal master
+#endif
+#ifdef DCC_DECODER
+#define HOST_DCC_ONE_US		58		// Nominal half-bit times
+#define HOST_DCC_ZERO_US	100
+#define HOST_DCC_PREAMBLE	14		// 1 bits sent before each packet
+#define HOST_DCC_REPEATS	4		// Times an 'A' command is sent
+static int32_t * hostDccHalf;	// The stream as half-bit times in us
+static uint8_t * hostDccEnd;	// Set on the last half of an accessory packet
+static size_t hostDccLen;
+static size_t hostDccSize;
+static size_t hostDccPos;
+static uint64_t hostDccLastEnd;	// Time of the last accessory packet end
+static uint16_t hostDccSeen;	// dccCommands at the last check
+static uint64_t hostDccLatency;	// Sum of packet end to servo target change times
+static uint32_t hostDccLatencyCount;
+#endif
+#ifdef TWI_SLAVE
+static FILE * hostTwiFile;		// -i script
+static uint32_t hostTwiWait;	// Tics left on a 'D' line
+static uint32_t hostTwiTransactions;
+static uint32_t hostTwiFails;	// Transactions not acknowledged in full
+#endif
+#ifdef FROG_RELAY
+#define HOST_FROG_CONTACT	35		// Percent of the throw a point stays against its stock rail
+#define HOST_FROG_OPERATE_MS	10	// Relay operate or release time, including bounce
+static uint8_t hostFrogContact;		// Bit n set while relay n's contacts are in the coil on position
+static uint32_t hostFrogShortMs[SERVO_COUNT];	// Time the frog was wired to the wrong rail
+#endif
+#define HOST_BENCH_CALLS	2000000L
+#define HOST_US(pos)		((pos) / (double)SERVO_UNITS_PER_US)
+#define HOST_T1_US(counts)	((counts) * (TIMER1_DIVISOR * 1e6 / FCPU))
+//
+// ============================================================================
+// hostNow -- Wall clock in nanoseconds
+//
+static double hostNow( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+//
+// ============================================================================
+// hostHeartBeat -- Raise one heartbeat tic as its ISR would
+//
+static void hostHeartBeat( void )
+{
+#ifdef TB_TIMER1
+	for ( uint8_t n=1; n<=SERVO_SUBFRAMES; ++n )
+		tbTimer1Period( SERVO_SUBFRAMES == n );		// A frame of timer1 periods
+#else
+	TIMER0_COMPA_vect();
+#endif
+}
+#ifdef TWI_SLAVE
+//
+// ============================================================================
+// hostTwiRun -- -i, run the next line of the TWI script
+//
+static void hostTwiRun( uint32_t tick )
+{
+	char line[256];
+	uint8_t data[64];
+	unsigned a, r, n;
+	char * p, * q;
+	int len, got;
+
+	if ( hostTwiWait ) {
+		--hostTwiWait;
+		return;
+	}
+	if ( !fgets( line, sizeof(line), hostTwiFile ) ) {
+		fclose( hostTwiFile );
+		hostTwiFile = NULL;
+		return;
+	}
+
+	switch ( line[0] ) {
+		case 'W':
+			if ( 2 != sscanf( line+1, "%x %x", &a, &r ) )
+				break;
+			strtoul( line+1, &p, 16 );
+			strtoul( p, &p, 16 );
+			data[0] = r;
+			for ( len=1; len<(int)sizeof(data); ++len, p=q ) {
+				data[len] = strtoul( p, &q, 16 );
+				if ( q == p )
+					break;
+			}
+			got = simTwiWrite( a, data, len );
+			++hostTwiTransactions;
+			hostTwiFails += ( got != len );
+			printf( "twi %lu: W %02x %02x, %d of %d bytes acknowledged\n", (unsigned long)tick, a, r, got, len );
+			break;
+
+		case 'R':
+			if ( (3 != sscanf( line+1, "%x %x %u", &a, &r, &n )) || (n > sizeof(data)) )
+				break;
+			data[0] = r;
+			got = simTwiWrite( a, data, 1 );
+			if ( 1 == got )
+				got = simTwiRead( a, data, n );
+			++hostTwiTransactions;
+			hostTwiFails += ( got != (int)n );
+			printf( "twi %lu: R %02x %02x:", (unsigned long)tick, a, r );
+			for ( int i=0; i<got; ++i )
+				printf( " %02x", data[i] );
+			printf( got < 0 ? " no acknowledge\n" : "\n" );
+			break;
+
+		case 'D':
+			hostTwiWait = strtoul( line+1, NULL, 0 );
+			break;
+
+		default:
+			break;
+	}
+}
+//
+// ============================================================================
+// hostTwiBenchmark -- Time register reads and writes through the USI ISRs
+//
+// Includes the simulated bus, so it is an upper bound on the ISR cost.
+//
+static void hostTwiBenchmark( void )
+{
+	uint8_t wr[3] = { TWI_REG_SERVO( 0 ) + TWI_SERVO_MIN, 0, 0 };
+	uint8_t rd[TWI_REG_SIZE];
+	double start, elapsed;
+	long n;
+
+	twiInit();
+	sei();
+	start = hostNow();
+	for ( n=0; n<HOST_BENCH_CALLS/10; ++n ) {
+		wr[0] = TWI_REG_ID;
+		simTwiWrite( twiAddress, wr, 1 );
+		simTwiRead( twiAddress, rd, sizeof(rd) );
+	}
+	elapsed = hostNow() - start;
+	printf( "TWI read:     %8.1f ns/byte, %u byte register map\n",
+			elapsed / (HOST_BENCH_CALLS/10) / (sizeof(rd) + 3), (unsigned)sizeof(rd) );
+
+	start = hostNow();
+	for ( n=0; n<HOST_BENCH_CALLS/10; ++n ) {
+		uint16_t pos = SERVO_DEFAULT_MIN + (n & 0x3F);
+
+		wr[0] = TWI_REG_SERVO( 0 ) + TWI_SERVO_MIN;
+		wr[1] = (uint8_t)pos;
+		wr[2] = pos >> 8;
+		simTwiWrite( twiAddress, wr, 3 );
+		twiPoll();
+	}
+	elapsed = hostNow() - start;
+	cli();
+	printf( "TWI write:    %8.1f ns/transaction including twiPoll(), %u rejected\n",
+			elapsed / (HOST_BENCH_CALLS/10), twiRejects );
+}
+#endif	// TWI_SLAVE
+#ifdef FROG_RELAY
+//
+// ============================================================================
+// hostFrogRun -- Time the frogs are wired to the wrong rail
+//
+// Each tic, the points are where servoMove() last put them. A point is against
+// the minPos stock rail for the first HOST_FROG_CONTACT percent of the throw
+// and against the maxPos one for the last, and a wheel bridging it to a frog
+// fed from the other rail is a short. The relay contacts follow the coil
+// driver HOST_FROG_OPERATE_MS into the tic it changes in.
+//
+static void hostFrogRun( void )
+{
+	static const uint16_t pins[SERVO_COUNT] = { FROG1_PIN, FROG2_PIN };
+	const uint16_t ms = 1000 / SERVO_HZ;
+
+	for ( uint8_t idx=0; idx<SERVO_COUNT; ++idx ) {
+		const servoData_t * s = &servo[idx];
+		uint16_t pin = pins[idx];
+		uint8_t on = ( (ePORTA == SERVO_PIN_PORT( pin )) ? PORTA : PORTD ) & SERVO_PIN_MASK( pin );
+		uint8_t mask = 1<<idx;
+		uint8_t contact = hostFrogContact & mask;
+		uint32_t span = s->maxPos - s->minPos;
+		uint32_t travel = s->currentPos - s->minPos;
+		uint8_t need;
+
+		if ( travel * 100 < span * HOST_FROG_CONTACT )
+			need = 0;
+		else if ( travel * 100 > span * (100 - HOST_FROG_CONTACT) )
+			need = mask;
+		else
+			need = 0xFF;					// Points clear of both rails
+
+		if ( !on != !contact ) {
+			if ( (0xFF != need) && (contact != need) )
+				hostFrogShortMs[idx] += HOST_FROG_OPERATE_MS;
+			hostFrogContact ^= mask;
+			contact ^= mask;
+			if ( (0xFF != need) && (contact != need) )
+				hostFrogShortMs[idx] += ms - HOST_FROG_OPERATE_MS;
+		}
+		else if ( (0xFF != need) && (contact != need) ) {
+			hostFrogShortMs[idx] += ms;
+		}
+	}
+}
+#endif	// FROG_RELAY
+//
+// ============================================================================
+// hostTickHook -- Scripted inputs, called by the simulator before each tic
+//
+static void hostTickHook( uint32_t tick )
+{
+	if ( hostFlipTick && (servo[servo1].targetPos != hostTarget) ) {
+		hostLatencyTics += tick - hostFlipTick;
+		++hostLatencyCount;
+		hostFlipTick = 0;
+	}
+	hostTarget = servo[servo1].targetPos;
+
+	if ( tick && (0 == tick % HOST_BTS1_PERIOD) ) {
+		PIND ^= (1<<BTS1_PIN);
+		hostFlipTick = tick;
+	}
+	if ( tick && (0 == tick % HOST_BTS2_PERIOD) )
+		PIND ^= (1<<BTS2_PIN);
+
+	if ( (tick >= HOST_PRESS_START) && (tick < HOST_PRESS_START + hostPresses*HOST_PRESS_PERIOD) ) {
+		if ( 0 == (tick - HOST_PRESS_START) % HOST_PRESS_PERIOD )
+			PIND &= ~(1<<BTPLUS_PIN);
+		else if ( HOST_PRESS_PERIOD/2 == (tick - HOST_PRESS_START) % HOST_PRESS_PERIOD )
+			PIND |= (1<<BTPLUS_PIN);
+	}
+
+	// The heartbeats the loop would have missed while stuck in a long job
+	if ( HOST_STALL_AT == tick ) {
+		for ( uint32_t n=0; n<hostStall; ++n )
+			hostHeartBeat();
+	}
+
+#ifdef TWI_SLAVE
+	if ( hostTwiFile )
+		hostTwiRun( tick );
+#endif
+#ifdef FROG_RELAY
+	if ( tick )
+		hostFrogRun();
+	else
+		hostFrogContact = frogState;	// The relays were set by frogInit()
+#endif
+
+#if SERVO_COUNT > 2
+	if ( tick && (0 == tick % HOST_MUX_PERIOD) )
+		servoToggle( 2 + (tick / HOST_MUX_PERIOD) % (SERVO_COUNT-2) );
+#endif
+}
+#ifdef UART_CONSOLE
+//
+// ============================================================================
+// hostUartFile/hostUartStdout -- -u, RXD from a file and TXD to stdout
+//
+// Like a script driving the console, each line is only sent once the reply
+// ("ok" or "?") to the one before has come back.
+//
+static int hostUartFile( void )
+{
+	uint8_t c;
+
+	if ( hostUartWait || (hostUartPos >= hostUartLen) )
+		return -1;
+
+	c = hostUartData[hostUartPos++];
+	if ( ('\r' == c) || ('\n' == c) ) {
+		hostUartWait = ( hostUartLine != 0 );
+		hostUartLine = 0;
+	}
+	else {
+		++hostUartLine;
+	}
+	return c;
+}
+
+static void hostUartStdout( uint8_t c )
+{
+	putchar( c );
+	hostUartDone = simTicks;
+
+	if ( ('\n' == c) && ('\r' == hostUartTail[2]) &&
+			(('?' == hostUartTail[1]) || (('o' == hostUartTail[0]) && ('k' == hostUartTail[1]))) )
+		hostUartWait = 0;
+	hostUartTail[0] = hostUartTail[1];
+	hostUartTail[1] = hostUartTail[2];
+	hostUartTail[2] = c;
+}
+//
+// ============================================================================
+// hostUartPtyIn/hostUartPtyOut -- -t, the USART on a pseudo-terminal
+//
+// Reads don't block, and fail with EIO while no terminal has the slave open.
+//
+static int hostUartPtyIn( void )
+{
+	uint8_t c;
+
+	return ( 1 == read( hostPty, &c, 1 ) ) ? c : -1;
+}
+
+static void hostUartPtyOut( uint8_t c )
+{
+	(void)!write( hostPty, &c, 1 );		// Nobody listening is fine
+}
+//
+// ============================================================================
+// hostUartOpen -- Set up the -u or -t connection, return 0 on success
+//
+static int hostUartOpen( const char * file, int pty )
+{
+	if ( file ) {
+		FILE * f = fopen( file, "rb" );
+		long len;
+
+		if ( !f || fseek( f, 0, SEEK_END ) || (len = ftell( f )) < 0 || fseek( f, 0, SEEK_SET ) )
+			return -1;
+		hostUartData = malloc( len + 1 );
+		hostUartLen = fread( hostUartData, 1, len, f );
+		fclose( f );
+		simUartIn = hostUartFile;
+		simUartOut = hostUartStdout;
+	}
+	if ( pty ) {
+		hostPty = posix_openpt( O_RDWR | O_NOCTTY );
+		if ( (hostPty < 0) || grantpt( hostPty ) || unlockpt( hostPty ) )
+			return -1;
+		fcntl( hostPty, F_SETFL, O_NONBLOCK );
+		fprintf( stderr, "console on %s\n", ptsname( hostPty ) );
+		simUartIn = hostUartPtyIn;
+		simUartOut = hostUartPtyOut;
+		simRealTime = 1;
+	}
+	return 0;
+}
+//
+// ============================================================================
+// hostConsoleBenchmark -- Time command lines through the USART ISRs and parser
+//
+// Each command goes byte by byte through the receive ISR, is run by
+// consolePoll() and its reply is drained through the data register empty ISR,
+// as on the part. The link rate is what UART_BAUD allows for the same lines.
+//
+static void hostConsoleBenchmark( void )
+{
+	static const char * const cmds[] = { "s 1 400\r", "m 2 1150\r", "x 1 1850\r", "+\r", "-\r", "q\r" };
+	const uint8_t count = sizeof(cmds) / sizeof(cmds[0]);
+	uint32_t in = 0, out = 0;
+	double start, elapsed;
+	const char * p;
+	long n;
+
+	uartInit();
+	start = hostNow();
+	for ( n=0; n<HOST_BENCH_CALLS; ++n ) {
+		for ( p=cmds[n % count]; *p; ++p ) {
+			UDR = *p;
+			USART_RX_vect();
+		}
+		consolePoll();
+		while ( UCSRB & (1<<UDRIE) ) {
+			UDR = 0x100;
+			USART_UDRE_vect();
+			out += ( UDR <= 0xFF );
+		}
+	}
+	elapsed = hostNow() - start;
+	for ( n=0; n<count; ++n )
+		in += strlen( cmds[n] );
+	out /= HOST_BENCH_CALLS / count;
+	printf( "console:      %8.1f ns/command, %.0f commands/s, link limit %.0f commands/s at %ld baud\n",
+			elapsed / HOST_BENCH_CALLS, HOST_BENCH_CALLS / (elapsed / 1e9),
+			UART_BAUD / 10.0 * count / ( in > out ? in : out ), UART_BAUD );
+}
+#endif	// UART_CONSOLE
+#ifdef DCC_DECODER
+//
+// ============================================================================
+// hostDccAdd -- Append a half-bit to the -d stream
+//
+static void hostDccAdd( int32_t us, uint8_t end )
+{
+	if ( hostDccLen >= hostDccSize ) {
+		hostDccSize = hostDccSize ? 2*hostDccSize : 4096;
+		hostDccHalf = realloc( hostDccHalf, hostDccSize * sizeof(*hostDccHalf) );
+		hostDccEnd = realloc( hostDccEnd, hostDccSize );
+	}
+	hostDccHalf[hostDccLen] = us;
+	hostDccEnd[hostDccLen++] = end;
+}
+//
+// ============================================================================
+// hostDccPacket -- Append a packet with its preamble to the -d stream
+//
+// A little deterministic jitter is added to the half-bit times, inside the
+// NMRA decoder tolerances.
+//
+static void hostDccPacket( const uint8_t * bytes, uint8_t len )
+{
+	static const int8_t jitter[] = { 0, 2, -3, 1, -1, 3, -2 };
+	uint8_t accessory = ( 3 == len ) && ( 0x80 == (bytes[0] & 0xC0) ) && ( bytes[1] & 0x80 );
+	uint16_t bits[1 + 9*DCC_PACKET_MAX];
+	uint16_t n = 0;
+
+	for ( uint8_t i=0; i<HOST_DCC_PREAMBLE; ++i )
+		bits[n++] = 1;
+	for ( uint8_t i=0; i<len; ++i ) {
+		bits[n++] = 0;						// Start or separator bit
+		for ( int8_t b=7; b>=0; --b )
+			bits[n++] = ( bytes[i] >> b ) & 1;
+	}
+	bits[n++] = 1;							// Packet end bit
+
+	for ( uint16_t i=0; i<n; ++i ) {
+		for ( uint8_t half=0; half<2; ++half ) {
+			int32_t us = ( bits[i] ? HOST_DCC_ONE_US : HOST_DCC_ZERO_US ) + jitter[hostDccLen % sizeof(jitter)];
+			hostDccAdd( us, accessory && (i == n-1) && half );
+		}
+	}
+}
+//
+// ============================================================================
+// hostDccLoad -- Read a -d stream file, return 0 on success
+//
+static int hostDccLoad( const char * file )
+{
+	FILE * f = fopen( file, "r" );
+	char line[256];
+	uint8_t bytes[DCC_PACKET_MAX];
+	unsigned a, b;
+	char * p, * q;
+	uint8_t len;
+
+	if ( !f )
+		return -1;
+
+	while ( fgets( line, sizeof(line), f ) ) {
+		switch ( line[0] ) {
+			case 'A':
+				if ( 2 != sscanf( line+1, "%u %u", &a, &b ) || (0 == a) )
+					break;
+				bytes[0] = 0x80 | ( ((a-1)/4 + 1) & 0x3F );
+				bytes[1] = 0x80 | ( (~((a-1)/4 + 1) >> 2) & 0x70 ) | 0x08 | ( ((a-1)%4) << 1 ) | ( b & 1 );
+				bytes[2] = bytes[0] ^ bytes[1];
+				for ( uint8_t i=0; i<HOST_DCC_REPEATS; ++i )
+					hostDccPacket( bytes, 3 );
+				break;
+
+			case 'P':
+				for ( len=0, p=line+1; len<DCC_PACKET_MAX; ++len, p=q ) {
+					a = strtoul( p, &q, 16 );
+					if ( q == p )
+						break;
+					bytes[len] = a;
+				}
+				hostDccPacket( bytes, len );
+				break;
+
+			case 'W':
+				bytes[0] = 0xFF;			// Idle packet, about 5ms each
+				bytes[1] = 0x00;
+				bytes[2] = 0xFF;
+				for ( a=strtoul( line+1, NULL, 0 ) / 5; a; --a )
+					hostDccPacket( bytes, 3 );
+				break;
+
+			default:
+				for ( p=line; ; p=q ) {
+					a = strtoul( p, &q, 10 );
+					if ( q == p )
+						break;
+					hostDccAdd( a, 0 );
+				}
+				break;
+		}
+	}
+	fclose( f );
+	return 0;
+}
+//
+// ============================================================================
+// hostDccIn -- Feed the -d stream to PA1, called by the simulator after each edge
+//
+// The firmware wakes on every edge, so a servo target change seen here was made
+// by dccPoll() between the last edge and this one. It is timed from the end
+// of the last accessory packet, to within one half-bit.
+//
+static int32_t hostDccIn( void )
+{
+	uint64_t now = (uint64_t)simTicks * SIM_TIC_US + simEdgeAt;
+
+	if ( dccCommands != hostDccSeen ) {
+		hostDccSeen = dccCommands;
+		hostDccLatency += now - hostDccLastEnd;
+		++hostDccLatencyCount;
+	}
+	if ( hostDccPos && hostDccEnd[hostDccPos-1] )
+		hostDccLastEnd = now;				// This edge ended an accessory packet
+
+	if ( hostDccPos >= hostDccLen )
+		return -1;
+	return hostDccHalf[hostDccPos++];
+}
+//
+// ============================================================================
+// hostDccBenchmark -- Time the edge ISR and dccPoll() on a stream of accessory packets
+//
+static void hostDccBenchmark( void )
+{
+	uint8_t bytes[3];
+	double start, elapsed;
+	uint32_t edges = 0;
+	uint32_t t = 0;
+	long n;
+
+	ICR1 = PWMTOP - 1;
+	for ( uint8_t i=0; i<64; ++i ) {
+		bytes[0] = 0x81;
+		bytes[1] = 0xF8 | ( i & 7 );
+		bytes[2] = bytes[0] ^ bytes[1];
+		hostDccPacket( bytes, 3 );
+	}
+
+	start = hostNow();
+	for ( n=0; n<HOST_BENCH_CALLS; ++n ) {
+		t = ( t + hostDccHalf[n % hostDccLen] ) % ((uint32_t)ICR1 + 1);
+		TCNT1 = t;
+		PCINT_A_vect();
+		dccPoll();
+		++edges;
+	}
+	elapsed = hostNow() - start;
+	printf( "DCC edge:     %8.1f ns/edge including dccPoll(), %u packets, %u errors\n",
+			elapsed / edges, dccPackets, dccErrors );
+	hostDccLen = 0;
+}
+#endif	// DCC_DECODER
+#ifdef SERVO_MUX
+//
+// ============================================================================
+// hostMuxBenchmark -- Time the schedule rebuild and one frame of mux ISRs
+//
+// Positions are spread over the range with two servos on the same edge and
+// two within MUX_MIN_GAP, so the merge and the busy-wait paths are both taken.
+//
+static void hostMuxBenchmark( void )
+{
+	double start, elapsed;
+	long n;
+
+	for ( uint8_t idx=0; idx<SERVO_COUNT; ++idx )
+		servo[idx].currentPos = SERVO_US( 1000 + 130*idx );
+	servo[1].currentPos = servo[0].currentPos;
+	servo[SERVO_COUNT-1].currentPos = servo[SERVO_COUNT-2].currentPos + SERVO_US( MUX_MIN_GAP/2 );
+
+	start = hostNow();
+	for ( n=0; n<HOST_BENCH_CALLS; ++n )
+		muxUpdate();
+	elapsed = hostNow() - start;
+	printf( "muxUpdate:    %8.1f ns/call, %u servos\n", elapsed / HOST_BENCH_CALLS, SERVO_COUNT );
+
+	start = hostNow();
+	for ( n=0; n<HOST_BENCH_CALLS; ++n ) {
+		TCNT1 = 0;
+		TIMER1_CAPT_vect();
+		while ( TIMSK & (1<<OCIE1A) ) {
+			TCNT1 = OCR1A;
+			TIMER1_COMPA_vect();
+		}
+	}
+	elapsed = hostNow() - start;
+	printf( "mux ISRs:     %8.1f ns/frame, worst compare ISR exit %u us past its edge\n",
+			elapsed / HOST_BENCH_CALLS, muxIsrMax );
+}
+#endif	// SERVO_MUX
+//
+// ============================================================================
+// hostBenchmark -- Time the per-tic functions
+//
+// servoMove() is timed once per motion profile with both servos permanently in
+// motion, the harness reverses a servo as soon as it arrives. btnHeartBeat() is timed with a
+// button input that changes every few calls so the debounce path is exercised, each call
+// includes the heartbeat ISR and, after a change, the pin change ISR.
+//
+static void hostBenchmark( void )
+{
+	static const char * const profileNames[] = { "linear", "trapezoid", "S-curve" };
+	double start, elapsed;
+	long n;
+
+	romServoDataInitialize();
+
+	for ( uint8_t profile=profileLinear; profile<=profileSCurve; ++profile ) {
+		for ( uint8_t idx=0; idx<SERVO_COUNT; ++idx )
+			servo[idx].motion.profile = profile;
+
+		start = hostNow();
+		for ( n=0; n<HOST_BENCH_CALLS; ++n ) {
+#ifdef SERVO_ISR_STEP
+			servoFrame();
+#endif
+			servoMove();
+			for ( uint8_t idx=0; idx<SERVO_COUNT; ++idx ) {
+				if ( servo[idx].currentPos == servo[idx].targetPos ) {
+					servo[idx].targetPos = ( servo[idx].targetPos == servo[idx].maxPos ) ?
+								servo[idx].minPos : servo[idx].maxPos;
+				}
+			}
+		}
+		elapsed = hostNow() - start;
+#ifdef SERVO_ISR_STEP
+		printf( "servoMove:    %8.1f ns/call with servoFrame(), %s\n", elapsed / HOST_BENCH_CALLS, profileNames[profile] );
+#else
+		printf( "servoMove:    %8.1f ns/call, %s\n", elapsed / HOST_BENCH_CALLS, profileNames[profile] );
+#endif
+	}
+
+	ICR1 = PWMTOP - 1;
+	start = hostNow();
+	for ( n=0; n<HOST_BENCH_CALLS; ++n ) {
+		if ( 0 == (n & 7) ) {
+			PIND ^= (1<<BTS1_PIN);
+			PCINT_D_vect();
+		}
+		hostHeartBeat();
+		btnHeartBeat();
+		while ( BTN_EVENT_NONE != btnEvent() )
+			;
+	}
+	elapsed = hostNow() - start;
+	printf( "btnHeartBeat: %8.1f ns/call\n", elapsed / HOST_BENCH_CALLS );
+
+	// Every LED breathing, so ledApply() rebuilds the planes on every step
+	OCR0A = TB_BASE - 1;
+	for ( uint8_t idx=0; idx<LED_COUNT; ++idx )
+		ledPattern( idx, ledMoving );
+	start = hostNow();
+	for ( n=0; n<HOST_BENCH_CALLS; ++n )
+		TIMER0_COMPB_vect();
+	elapsed = hostNow() - start;
+	printf( "LED slot ISR: %8.1f ns/call, any levels\n", elapsed / HOST_BENCH_CALLS );
+
+	start = hostNow();
+	for ( n=0; n<HOST_BENCH_CALLS; ++n ) {
+		ledLevel( LED1, n & LED_LEVEL_ON );
+		ledApply();
+	}
+	elapsed = hostNow() - start;
+	printf( "ledApply:     %8.1f ns/call, rebuilding every call\n", elapsed / HOST_BENCH_CALLS );
+
+#ifdef SERVO_MUX
+	hostMuxBenchmark();
+#endif
+#ifdef UART_CONSOLE
+	hostConsoleBenchmark();
+#endif
+#ifdef DCC_DECODER
+	hostDccBenchmark();
+#endif
+#ifdef TWI_SLAVE
+	hostTwiBenchmark();
+#endif
+}
+//
+// ============================================================================
+// hostMotionRun -- Step one move of s to target, checking it on the way
+//
+// return the tics it took, 0 if it overshot, went backwards or never arrived
+//
+static uint32_t hostMotionRun( servoData_t * s, uint16_t target, uint32_t limit )
+{
+	uint16_t	from = s->currentPos;
+	uint16_t	last = from;
+	uint32_t	tics;
+
+	s->targetPos = target;
+	for ( tics=1; tics<=limit; ++tics ) {
+		motionStep( s );
+		if ( (target >= from) ? ((s->currentPos < last) || (s->currentPos > target))
+							  : ((s->currentPos > last) || (s->currentPos < target)) )
+			return 0;
+		if ( s->currentPos == target )
+			return tics;
+		last = s->currentPos;
+	}
+	return 0;
+}
+//
+// ============================================================================
+// hostMotionCheck -- Check that every move lands exactly on targetPos
+//
+// For each profile, throw times from MOTION_THROW_MIN_MS to MOTION_THROW_MAX_MS
+// over several spans: a full throw must take exactly throwTics, a throw reversed
+// part way its share of them, never overshooting or backing up. Moves at vMax
+// must get there too. Prints each failure.
+//
+// return the number of failed moves
+//
+static int hostMotionCheck( void )
+{
+	static const uint16_t throwMs[] = { 0, MOTION_THROW_MIN_MS, 230, 1000, 1234, 5000, 29990, MOTION_THROW_MAX_MS };
+	static const uint16_t spans[] = { 1, 7, SERVO_US(100), SERVO_US(600) + 3, SERVO_ABSOLUTE_MAX - SERVO_ABSOLUTE_MIN };
+	static const motion_t rest = { .profile = MOTION_DEFAULT_PROFILE, .vMax = MOTION_DEFAULT_VMAX,
+										.accel = MOTION_DEFAULT_ACCEL };
+	servoData_t	s;
+	uint32_t	tics, want, back;
+	int			moves = 0;
+	int			failed = 0;
+
+	for ( uint8_t profile=profileLinear; profile<=profileSCurve; ++profile ) {
+		for ( unsigned t=0; t<sizeof(throwMs)/sizeof(throwMs[0]); ++t ) {
+			for ( unsigned n=0; n<sizeof(spans)/sizeof(spans[0]); ++n ) {
+				memset( &s, 0, sizeof(s) );
+				s.minPos = SERVO_ABSOLUTE_MIN;
+				s.maxPos = SERVO_ABSOLUTE_MIN + spans[n];
+				s.currentPos = s.targetPos = s.minPos;
+				s.motion = rest;
+				s.motion.profile = profile;
+				s.motion.throwTics = MOTION_THROW_TICS( throwMs[t] );
+				s.motion.goal = s.currentPos;
+
+				// A full throw, then back a third of the way and out again
+				back = s.motion.throwTics ? s.motion.throwTics / 3 : 10;
+				tics = hostMotionRun( &s, s.maxPos, 0x20000 );
+				want = s.motion.throwTics ? s.motion.throwTics : tics;
+				++moves;
+				if ( !tics || (tics != want) ) {
+					printf( "motion: profile %u, %ums, span %u: full throw took %u tics, wanted %u\n",
+							profile, throwMs[t], spans[n], tics, want );
+					++failed;
+					continue;
+				}
+
+				s.targetPos = s.minPos;
+				for ( uint32_t k=0; (k<back) && (s.currentPos != s.minPos); ++k )
+					motionStep( &s );
+				want = s.motion.throwTics ?
+						((uint32_t)s.motion.throwTics * (s.maxPos - s.currentPos) + spans[n]/2) / spans[n] : 0;
+				if ( (s.currentPos != s.maxPos) && s.motion.throwTics && (want < 1) )
+					want = 1;								// Any move takes a tic
+				tics = ( s.currentPos == s.maxPos ) ? 0 : hostMotionRun( &s, s.maxPos, 0x20000 );
+				++moves;
+				if ( (s.currentPos != s.maxPos) || (want && (tics != want)) ) {
+					printf( "motion: profile %u, %ums, span %u: reversal took %u tics, wanted %u\n",
+							profile, throwMs[t], spans[n], tics, want );
+					++failed;
+				}
+			}
+		}
+	}
+	printf( "motion: %d moves checked, %d failed\n", moves, failed );
+	return failed;
+}
+//
+// ============================================================================
+//
+int main( int argc, char ** argv )
+{
+	const char * eepromFile = NULL;
+	const char * uartFile = NULL;
+	const char * dccFile = NULL;
+	const char * twiFile = NULL;
+	int frogPct = -1;
+	int pty = 0;
+	uint32_t tics = 3000;
+	int bench = 0;
+	int check = 0;
+	int quiet = 0;
+	uint32_t pulsed = 0;
+	int opt;
+	double start, elapsed;
+
+	while ( (opt = getopt( argc, argv, "n:e:p:s:u:td:i:f:bmq" )) != -1 ) {
+		switch ( opt ) {
+			case 'n':
+				tics = strtoul( optarg, NULL, 0 );
+				break;
+			case 'e':
+				eepromFile = optarg;
+				break;
+			case 'p':
+				hostPresses = strtoul( optarg, NULL, 0 );
+				break;
+			case 's':
+				hostStall = strtoul( optarg, NULL, 0 );
+				break;
+			case 'u':
+				uartFile = optarg;
+				break;
+			case 't':
+				pty = 1;
+				break;
+			case 'd':
+				dccFile = optarg;
+				break;
+			case 'i':
+				twiFile = optarg;
+				break;
+			case 'f':
+				frogPct = strtoul( optarg, NULL, 0 );
+				break;
+			case 'b':
+				bench = 1;
+				break;
+			case 'm':
+				check = 1;
+				break;
+			case 'q':
+				quiet = 1;
+				break;
+			default:
+				fprintf( stderr, "usage: %s [-n tics] [-e eeprom.bin] [-p presses] [-s tics] [-u file] [-t] [-d file] [-i file] [-f pct] [-b] [-m] [-q]\n", argv[0] );
+				return 2;
+		}
+	}
+
+	simReset();
+	if ( eepromFile && simEepromLoad( eepromFile ) )
+		fprintf( stderr, "%s: no EEPROM image, starting erased\n", eepromFile );
+#ifdef FROG_RELAY
+	if ( (frogPct >= 0) && (frogPct < 100) ) {
+		for ( uint8_t idx=0; idx<SERVO_COUNT; ++idx ) {
+			simEeprom[ROM_ADDR_FROG( idx )] = (frogPct * 256 + 50) / 100;
+			simEeprom[ROM_ADDR_FROG( idx ) + 1] = ~simEeprom[ROM_ADDR_FROG( idx )];
+		}
+	}
+	else if ( frogPct >= 0 ) {
+		fprintf( stderr, "-f takes 0 to 99\n" );
+		return 2;
+	}
+#else
+	if ( frogPct >= 0 ) {
+		fprintf( stderr, "-f needs a FROG_RELAY build\n" );
+		return 2;
+	}
+#endif
+
+	if ( bench ) {
+		hostBenchmark();
+		return 0;
+	}
+	if ( check )
+		return hostMotionCheck() ? 1 : 0;
+
+	simTickLimit = tics;
+	simTickHook = hostTickHook;
+#ifdef UART_CONSOLE
+	if ( (uartFile || pty) && hostUartOpen( uartFile, pty ) ) {
+		perror( uartFile ? uartFile : "pseudo-terminal" );
+		return 1;
+	}
+#else
+	if ( uartFile || pty ) {
+		fprintf( stderr, "-u and -t need a UART_CONSOLE build\n" );
+		return 2;
+	}
+#endif
+#ifdef DCC_DECODER
+	if ( dccFile ) {
+		if ( hostDccLoad( dccFile ) ) {
+			perror( dccFile );
+			return 1;
+		}
+		simEdgeIn = hostDccIn;
+	}
+#else
+	if ( dccFile ) {
+		fprintf( stderr, "-d needs a DCC_DECODER build\n" );
+		return 2;
+	}
+#endif
+#ifdef TWI_SLAVE
+	if ( twiFile && !(hostTwiFile = fopen( twiFile, "r" )) ) {
+		perror( twiFile );
+		return 1;
+	}
+#else
+	if ( twiFile ) {
+		fprintf( stderr, "-i needs a TWI_SLAVE build\n" );
+		return 2;
+	}
+#endif
+
+	start = hostNow();
+	firmwareMain();
+	elapsed = hostNow() - start;
+
+	printf( "%lu tics in %.3f s, %.0f tics/s, %lu EEPROM bytes written\n",
+			(unsigned long)simTicks, elapsed / 1e9, simTicks / (elapsed / 1e9),
+			(unsigned long)simEepromWrites );
+#ifdef TB_TIMER1
+	printf( "heartbeat: %.4f Hz from timer1, uptime %lu tics, %u missed, worst latency %.2f ms\n",
+			tbUptime * (FCPU / (double)TIMER1_DIVISOR) / (tbClock - tbClock % (PWMTOP * SERVO_SUBFRAMES)),
+			(unsigned long)tbUptime,
+			tbMissed, tbLatencyMax * (TB_PRESCALE * 1e3 / FCPU) );
+#else
+	printf( "heartbeat: %.4f Hz, uptime %lu tics, %u missed, worst latency %.2f ms\n",
+			simTicks * (FCPU / (double)TB_PRESCALE) / simTimer0Counts, (unsigned long)tbUptime,
+			tbMissed, tbLatencyMax * (TB_PRESCALE * 1e3 / FCPU) );
+#endif
+	if ( hostLatencyCount )
+		printf( "buttons: BTS1 to servo1 %.1f ms average, resolution one tic\n",
+				hostLatencyTics * 1000.0 / SERVO_HZ / hostLatencyCount );
+	printf( "EEPROM queue: depth %u, max %u, overflows %u, flags 0x%02x\n",
+			romQueueDepth(), romQueueMax, romQueueOverflows, eepromUpdateFlag );
+	if ( !quiet ) {
+		for ( uint8_t idx=0; idx<SERVO_COUNT; ++idx ) {
+#ifdef SERVO_MUX
+			static const uint8_t simPort[] = { [ePORTA] = SIM_PORTA, [ePORTB] = SIM_PORTB, [ePORTD] = SIM_PORTD };
+			uint8_t port = simPort[ SERVO_PIN_PORT( servo[idx].Pin ) ];
+			uint8_t bit = __builtin_ctz( SERVO_PIN_MASK( servo[idx].Pin ) );
+			uint32_t pulses = simPinPulseCount[port][bit];
+			uint16_t width = simPinPulseWidth[port][bit];
+#else
+			uint32_t pulses = simPulseCount[idx];
+			uint16_t width = simPulseWidth[idx];
+#endif
+			printf( "servo%u: min %.3f max %.3f target %.3f current %.3f us, %lu pulses, last %.3f us\n",
+					idx+1, HOST_US( servo[idx].minPos ), HOST_US( servo[idx].maxPos ),
+					HOST_US( servo[idx].targetPos ), HOST_US( servo[idx].currentPos ),
+					(unsigned long)pulses, HOST_T1_US( width ) );
+			pulsed += pulses;
+		}
+		printf( "LEDs: on LD1A %.1f%% LD1B %.1f%% LD2A %.1f%% LD2B %.1f%% LED1 %.1f%% of the run, %.0f slot ISRs/s\n",
+				100.0 * simPinHighCounts[SIM_PORTB][LD1A_PIN] / simTimer0Counts,
+				100.0 * simPinHighCounts[SIM_PORTB][LD1B_PIN] / simTimer0Counts,
+				100.0 * simPinHighCounts[SIM_PORTD][LD2A_PIN] / simTimer0Counts,
+				100.0 * simPinHighCounts[SIM_PORTD][LD2B_PIN] / simTimer0Counts,
+				100.0 * simPinHighCounts[SIM_PORTB][LED1_PIN] / simTimer0Counts,
+				simTimer0CompB * (FCPU / (double)TB_PRESCALE) / simTimer0Counts );
+		printf( "outputs: %u attaches, %u detaches, pulsed %.1f%% of frames, ~%.1f mA per servo at %u mA while pulsed\n",
+				servoAttachCount, servoDetachCount, 100.0 * pulsed / ((double)simTicks * SERVO_COUNT),
+				(double)HOST_HOLD_MA * pulsed / ((double)simTicks * SERVO_COUNT), HOST_HOLD_MA );
+#ifdef IDLE_STATS
+		printf( "idle: awake %.3f%% of %lu tics, worst %.1f us between sleeps (host CPU time)\n",
+				100.0 * idleActiveCounts * TIMER1_DIVISOR / ((double)idleTics * FCPU / SERVO_HZ),
+				(unsigned long)idleTics, HOST_T1_US( idleActiveMax ) );
+#endif
+#ifdef SCHED_STATS
+		printf( "tasks: worst" );
+		for ( uint8_t idx=0; pgm_read_ptr( &schedTasks[idx].run ); ++idx )
+			printf( " %.1f", HOST_T1_US( schedWorst[idx] ) );
+		printf( " us each, in table order (host CPU time)\n" );
+#endif
+#ifdef SERVO_MUX
+		printf( "mux: worst compare ISR exit %.0f us past its edge\n", HOST_T1_US( muxIsrMax ) );
+#endif
+#ifdef DCC_DECODER
+		printf( "DCC: %lu edges (%.0f/s), %u packets, %u errors, %u overruns, %u commands, %.2f ms average latency\n",
+				(unsigned long)simEdges, simEdges * (double)SERVO_HZ / simTicks, dccPackets, dccErrors, dccOverruns,
+				dccCommands, hostDccLatencyCount ? hostDccLatency / 1e3 / hostDccLatencyCount : 0.0 );
+#endif
+#ifdef TWI_SLAVE
+		printf( "TWI: address 0x%02x, %lu transactions, %lu not acknowledged in full, %u writes applied, %u rejected, %u bytes NACKed\n",
+				twiAddress, (unsigned long)hostTwiTransactions, (unsigned long)hostTwiFails, twiWrites, twiRejects, twiNacks );
+#endif
+#ifdef FROG_RELAY
+		for ( uint8_t idx=0; idx<SERVO_COUNT; ++idx ) {
+			printf( "frog%u: switch point %.1f%%, %u flips, %lu ms wired to the wrong rail, coil on %.1f%% of the run\n",
+					idx+1, frogPoint[idx] * 100.0 / 256, frogFlips[idx], (unsigned long)hostFrogShortMs[idx],
+					100.0 * frogOnTics[idx] / simTicks );
+		}
+		printf( "frog: %u flips held for the dwell time\n", frogHeld );
+#endif
+#ifdef UART_CONSOLE
+		printf( "console: %u commands, last reply at %.2f s (%.0f commands/s), %u bytes lost on RXD, %u dropped on TXD\n",
+				consoleCommands, hostUartDone / (double)SERVO_HZ,
+				hostUartDone ? consoleCommands * (double)SERVO_HZ / hostUartDone : 0.0, uartRxOverflows, uartTxDrops );
+#endif
+	}
+
+	if ( eepromFile && simEepromSave( eepromFile ) ) {
+		perror( eepromFile );
+		return 1;
+	}
+
+	return 0;
+}
+//
+// ============================================================================
+//
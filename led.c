@@ -6,57 +6,127 @@
 // ============================================================================
 //
 #include <stdint.h>
-#include <avr/io.h>
 //
+#include "hal.h"
 #include "led.h"
 //
 // ============================================================================
+// Port and pin of each enum eLED
+//
+static const led_t leds[LED_COUNT] PROGMEM = {
+	{ ledPortB,	1<<LD1A_PIN },
+	{ ledPortB,	1<<LD1B_PIN },
+	{ ledPortD,	1<<LD2A_PIN },
+	{ ledPortD,	1<<LD2B_PIN },
+	{ ledPortB,	LED1_MASK },
+	{ ledPortD,	LED2_MASK },
+};
+//
+// Level of each pattern step, ledSteady isn't used
+static const uint8_t ledPatterns[LED_PATTERNS][LED_PATTERN_STEPS] PROGMEM = {
+	{ 15, 15, 15, 15, 15, 15, 15, 15 },		// ledSteady
+	{ 15, 11,  6,  2,  1,  2,  6, 11 },		// ledMoving, breathing
+	{ 15,  0, 15,  0, 15,  0, 15,  0 },		// ledCalibrating, fast blink
+	{ 15,  0, 15,  0,  0,  0,  0,  0 },		// ledEepromError, double blink
+};
+//
+static uint8_t ledLevels[LED_COUNT];		// Level for ledSteady
+static uint8_t ledPatternOf[LED_COUNT];		// enum eLEDPattern
+static uint8_t ledStep;						// Pattern step
+static uint8_t ledStepTics;					// Tics until the next step
+static uint8_t ledChanged = 1;				// Bit-planes need rebuilding
+//
+// Bit-planes, LEDs lit in each slot. Written by ledApply(), read by the ISR.
+static volatile uint8_t ledPlane[LED_BITS][LED_PORTS];
+static uint8_t ledSlot;						// Slot being shown
+//
+// ============================================================================
 // ledConfig -- Configure the LED interface
 //
-// Configure port pins as output and turn them off
+// Configure port pins as output and turn them off, start the BAM slots on
+// timer0 compare B. Needs the timebase running.
 //
 void ledConfig( void )
 {
-	DDRB  |=  (1<<LD1A_PIN | 1<<LD1B_PIN | 1<<LED1_PIN);
-	PORTB &= ~(1<<LD1A_PIN | 1<<LD1B_PIN | 1<<LED1_PIN);
+	DDRB  |=  LED_MASK_B;
+	PORTB &= ~LED_MASK_B;
 
-	DDRD  |=  (1<<LD2A_PIN | 1<<LD2B_PIN | 1<<LED2_PIN);
-	PORTD &= ~(1<<LD2A_PIN | 1<<LD2B_PIN | 1<<LED2_PIN);
-}
+	DDRD  |=  LED_MASK_D;
+	PORTD &= ~LED_MASK_D;
 
+	ledSlot = LED_BITS - 1;
+	OCR0B = 0;
+	TIFR = (1<<OCF0B);
+	TIMSK |= (1<<OCIE0B);
+}
+//
 // ============================================================================
-// ledOff -- turn off the specified LED
+// TIMER0_COMPB -- ISR, show the next BAM slot
 //
-void ledOff( enum eLED idx )
+// Slot n lasts 1<<n timer0 counts. Cost is fixed: two port writes and one
+// compare update, whatever the LED levels.
+//
+ISR(TIMER0_COMPB_vect)
 {
-	switch( idx ) {
-		case LD1A:
-			PORTB &= ~(1<<LD1A_PIN);
-			break;
+	uint8_t slot = ( ledSlot + 1 ) & (LED_BITS - 1);
+	uint8_t next;
 
-		case LD1B:
-			PORTB &= ~(1<<LD1B_PIN);
-			break;
+	ledSlot = slot;
+	PORTB = (PORTB & ~LED_MASK_B) | ledPlane[slot][ledPortB];
+	PORTD = (PORTD & ~LED_MASK_D) | ledPlane[slot][ledPortD];
 
-		case LD2A:
-			PORTD &= ~(1<<LD2A_PIN);
-			break;
+	next = OCR0B + (1<<slot);
+	if ( next > OCR0A )
+		next -= OCR0A + 1;			// Timer0 will have wrapped by then
+	OCR0B = next;
+}
+//
+// ============================================================================
+// ledLevel -- Set the level of the specified LED, 0 to LED_LEVEL_ON
+//
+// Shown while the LED's pattern is ledSteady.
+//
+void ledLevel( enum eLED idx, uint8_t level )
+{
+	if ( idx >= LED_COUNT )
+		return;
 
-		case LD2B:
-			PORTD &= ~(1<<LD2B_PIN);
-			break;
+	if ( ledLevels[idx] != level ) {
+		ledLevels[idx] = level;
+		ledChanged |= ( ledSteady == ledPatternOf[idx] );
+	}
+}
+//
+// ============================================================================
+// ledPattern -- Make the specified LED follow a pattern
+//
+// ledSteady goes back to showing the LED's level.
+//
+void ledPattern( enum eLED idx, enum eLEDPattern pattern )
+{
+	if ( (idx >= LED_COUNT) || (pattern >= LED_PATTERNS) )
+		return;
 
-		case LED1:
-			PORTB &= ~(1<<LED1_PIN);
-			break;
+	if ( ledPatternOf[idx] != pattern ) {
+		ledPatternOf[idx] = pattern;
+		ledChanged = 1;
+	}
+}
 
-		case LED2:
-			PORTD &= ~(1<<LED2_PIN);
-			break;
+// ============================================================================
+// ledSet -- turn the specified LED fully on or off
+//
+void ledSet( enum eLED idx, uint8_t on )
+{
+	ledLevel( idx, on ? LED_LEVEL_ON : 0 );
+}
 
-		default:
-			break;
-	}
+// ============================================================================
+// ledOff -- turn off the specified LED
+//
+void ledOff( enum eLED idx )
+{
+	ledLevel( idx, 0 );
 }
 
 // ============================================================================
@@ -64,32 +134,47 @@ void ledOff( enum eLED idx )
 //
 void ledOn( enum eLED idx )
 {
-	switch( idx ) {
-		case LD1A:
-			PORTB |= (1<<LD1A_PIN);
-			break;
-
-		case LD1B:
-			PORTB |= (1<<LD1B_PIN);
-			break;
+	ledLevel( idx, LED_LEVEL_ON );
+}
 
-		case LD2A:
-			PORTD |= (1<<LD2A_PIN);
-			break;
+// ============================================================================
+// ledApply -- Step the patterns and rebuild the bit-planes if anything changed
+//
+// Each LED's level is spread over the planes with masks rather than tests, so
+// the cost is the same for every LED. Each plane is written with interrupts
+// off so the ISR never sees one port updated and the other not.
+//
+void ledApply( void )
+{
+	uint8_t		plane[LED_BITS][LED_PORTS];
+	uint8_t		idx, bit, level, port, mask;
 
-		case LD2B:
-			PORTD |= (1<<LD2B_PIN);
-			break;
+	if ( 0 == ledStepTics-- ) {
+		ledStepTics = LED_STEP_TICS - 1;
+		ledStep = ( ledStep + 1 ) & (LED_PATTERN_STEPS - 1);
+		for ( idx=0; idx<LED_COUNT; ++idx )
+			ledChanged |= ( ledPatternOf[idx] != ledSteady );
+	}
+	if ( !ledChanged )
+		return;
+	ledChanged = 0;
 
-		case LED1:
-			PORTB |= (1<<LED1_PIN);
-			break;
+	for ( bit=0; bit<LED_BITS; ++bit )
+		plane[bit][ledPortB] = plane[bit][ledPortD] = 0;
 
-		case LED2:
-			PORTD |= (1<<LED2_PIN);
-			break;
+	for ( idx=0; idx<LED_COUNT; ++idx ) {
+		level = ( ledSteady == ledPatternOf[idx] ) ? ledLevels[idx] :
+					pgm_read_byte( &ledPatterns[ ledPatternOf[idx] ][ ledStep ] );
+		port = pgm_read_byte( &leds[idx].port );
+		mask = pgm_read_byte( &leds[idx].mask );
+		for ( bit=0; bit<LED_BITS; ++bit )
+			plane[bit][port] |= mask & -((level >> bit) & 1);
+	}
 
-		default:
-			break;
+	for ( bit=0; bit<LED_BITS; ++bit ) {
+		ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+			ledPlane[bit][ledPortB] = plane[bit][ledPortB];
+			ledPlane[bit][ledPortD] = plane[bit][ledPortD];
+		}
 	}
 }
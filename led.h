@@ -21,7 +21,7 @@
 //
 enum eLED { LD1A, LD1B, LD2A, LD2B, LED1, LED2 };
 //
-#define LED_COUNT	5
+#define LED_COUNT	6
 //
 // PORTB LEDs
 #define	LD1A_PIN		0
@@ -33,11 +33,60 @@ enum eLED { LD1A, LD1B, LD2A, LD2B, LED1, LED2 };
 #define	LD2B_PIN		6
 #define	LED2_PIN		4
 //
-//extern led_t leds[LED_COUNT];
+// Brightness is bit angle modulated from the timer0 compare B interrupt. Each
+// LED has a 4 bit level, a BAM cycle is LED_LEVELS-1 timer0 counts (1.9ms at
+// 8MHz) split into slots of 1, 2, 4 and 8 counts, and in slot n the LEDs with
+// bit n of their level set are lit. The ISR writes one precomputed bit-plane
+// per port, so its cost doesn't depend on the number of LEDs or their levels.
+// OCR0B isn't buffered in CTC mode, the ISR moves it on to the next slot and
+// wraps it at OCR0A, so the cycle runs freely across heartbeat periods.
+//
+// An LED either shows a fixed level or follows a PROGMEM pattern of
+// LED_PATTERN_STEPS levels, one step every LED_STEP_TICS. ledApply() is called
+// once per tic and rebuilds the bit-planes only when a level has changed or a
+// pattern has stepped.
+//
+// With SERVO_MUX, LED1 and LED2 are servo outputs and have no pins here. With
+// FROG_RELAY, LED2's pin drives a frog relay.
+//
+enum eLEDPort { ledPortB, ledPortD, LED_PORTS };
+//
+// Patterns, see led.c
+enum eLEDPattern { ledSteady, ledMoving, ledCalibrating, ledEepromError, LED_PATTERNS };
+//
+#define LED_BITS			4
+#define LED_LEVELS			(1<<LED_BITS)
+#define LED_LEVEL_ON		(LED_LEVELS-1)
+#define LED_PATTERN_STEPS	8
+#define LED_STEP_TICS		5		// 100ms per pattern step
+//
+// Pin masks of the debug LEDs, 0 when they aren't fitted
+#ifdef SERVO_MUX
+#define LED1_MASK		0
+#else
+#define LED1_MASK		(1<<LED1_PIN)
+#endif
+#if defined( SERVO_MUX ) || defined( FROG_RELAY )
+#define LED2_MASK		0
+#else
+#define LED2_MASK		(1<<LED2_PIN)
+#endif
+//
+#define LED_MASK_B		((1<<LD1A_PIN) | (1<<LD1B_PIN) | LED1_MASK)
+#define LED_MASK_D		((1<<LD2A_PIN) | (1<<LD2B_PIN) | LED2_MASK)
+//
+typedef struct {
+	uint8_t		port;			// enum eLEDPort
+	uint8_t		mask;			// Pin mask, 0 if the LED isn't fitted
+} led_t;
 //
 extern void ledConfig( void );
 extern void ledOff( enum eLED idx );
 extern void ledOn( enum eLED idx );
+extern void ledSet( enum eLED idx, uint8_t on );
+extern void ledLevel( enum eLED idx, uint8_t level );
+extern void ledPattern( enum eLED idx, enum eLEDPattern pattern );
+extern void ledApply( void );
 //
 // ============================================================================
 #endif	// _LED_H_
@@ -0,0 +1,211 @@
+//
+// ============================================================================
+//
+// motion.c -- Motion profile engine for the servo subsystem
+//
+// ============================================================================
+//
+#include <stdint.h>
+//
+#include "hal.h"
+#include "servoturnout.h"
+//
+#include "servo.h"
+#include "motion.h"
+//
+// ============================================================================
+// S-curve easing table, smootherstep 6t^5-15t^4+10t^3 scaled to MOTION_SCURVE_ONE
+// with 1<<MOTION_SCURVE_SHIFT intervals. Entries in between are interpolated.
+//
+static const uint16_t motionSCurve[(1<<MOTION_SCURVE_SHIFT)+1] PROGMEM = {
+	    0,     1,    10,    31,    73,   139,   233,   361,
+	  526,   730,   975,  1264,  1598,  1977,  2403,  2875,
+	 3392,  3954,  4561,  5209,  5898,  6626,  7391,  8189,
+	 9018,  9875, 10758, 11662, 12584, 13521, 14469, 15425,
+	16384, 17343, 18299, 19247, 20184, 21106, 22010, 22893,
+	23750, 24579, 25377, 26142, 26870, 27559, 28207, 28814,
+	29376, 29893, 30365, 30791, 31170, 31504, 31793, 32038,
+	32242, 32407, 32535, 32629, 32695, 32737, 32758, 32767,
+	32768,
+};
+//
+// ============================================================================
+// motionDistance -- Unsigned distance between two positions
+//
+static uint16_t motionDistance( uint16_t a, uint16_t b )
+{
+	return ( a > b ) ? a - b : b - a;
+}
+//
+// ============================================================================
+// motionEase -- Fraction of a phase driven move done at phase, /MOTION_SCURVE_ONE
+//
+// The trapezoid spends a quarter of the time accelerating and a quarter
+// braking, so it cruises at 4/3 of the average velocity: f = 8/3 p^2 up to
+// p = 1/4, then 4/3 (p - 1/8), mirrored about p = 1/2. 43691 is 4/3 in Q15.
+// The ramp is rounded up, so the mirrored half stays short of the goal until
+// the phase wraps, as the other curves do.
+//
+static uint16_t motionEase( uint8_t profile, uint32_t phase )
+{
+	uint16_t	p = phase >> 16;
+	uint16_t	q;
+	uint16_t	f0, f1;
+	uint8_t		i;
+
+	switch ( profile ) {
+		case profileSCurve:
+			i = phase >> (32 - MOTION_SCURVE_SHIFT);
+			f0 = pgm_read_word( &motionSCurve[i] );
+			f1 = pgm_read_word( &motionSCurve[i+1] );
+			return f0 + (((uint32_t)(f1 - f0) * (uint8_t)(phase >> (24 - MOTION_SCURVE_SHIFT))) >> 8);
+
+		case profileTrapezoid:
+			q = ( p < 0x8000 ) ? p : -p;		// Distance in time from the nearer end
+			if ( q < 0x4000 )
+				f0 = (((((uint32_t)q * q + 0xFFFF) >> 16) * 43691) + 0x7FFF) >> 15;
+			else
+				f0 = ((uint32_t)(q - 0x2000) * 43691) >> 16;
+			return ( p < 0x8000 ) ? f0 : MOTION_SCURVE_ONE - f0;
+
+		default:
+			return p >> 1;
+	}
+}
+//
+// ============================================================================
+// motionPlan -- Plan a new move from pos to target
+//
+// A trapezoid move that continues in the direction the servo is already going
+// keeps its velocity, ramp is then the distance needed to brake from it,
+// v^2/2a. Anything else starts from rest.
+//
+// A timed move takes throwTics times its share of span, the full throw. An
+// untimed S-curve peaks at 15/8 of its average velocity, the move is stretched
+// so that peak is vMax. phaseStep is 2^32/tics rounded up, so (tics-1) steps
+// stay short of 2^32 and the tics'th one wraps.
+//
+void motionPlan( const motion_t * m, uint16_t pos, uint16_t target, uint16_t span, motionPlan_t * p )
+{
+	uint16_t	dist;
+	uint32_t	tics;
+
+	p->keep = ((target > pos) && (m->goal > pos)) || ((target < pos) && (m->goal < pos));
+
+	p->goal = target;
+	p->ramp = 0;
+	if ( p->keep && m->velocity && m->accel ) {
+		p->ramp = ((uint32_t)m->velocity * m->velocity) / ((uint32_t)m->accel << 9);
+	}
+
+	dist = motionDistance( pos, target );
+	if ( m->throwTics )
+		tics = ((uint32_t)m->throwTics * dist + span/2) / ( span ? span : 1 );
+	else
+		tics = ((uint32_t)dist * 15 * 32) / ( m->vMax ? m->vMax : 1 );	// dist * 15/8 * 256 / vMax
+	if ( tics <= 1 )
+		p->phaseStep = 0;						// Arrive on the first tic
+	else if ( tics >= 0x10000 )
+		p->phaseStep = 0x10000;
+	else
+		p->phaseStep = 0xFFFFFFFFUL / tics + 1;
+}
+//
+// ============================================================================
+// motionAdopt -- Start a planned move from pos
+//
+void motionAdopt( motion_t * m, uint16_t pos, const motionPlan_t * p )
+{
+	if ( !p->keep )
+		m->velocity = 0;
+	m->goal = p->goal;
+	m->start = pos;
+	m->ramp = p->ramp;
+	m->phase = 0;
+	m->phaseStep = p->phaseStep;
+}
+//
+// ============================================================================
+// motionStep -- Move currentPos one tic closer to targetPos
+//
+// A change of targetPos, by a toggle or a limit adjustment, starts a new move
+// from wherever the servo is. currentPos always lands exactly on targetPos.
+//
+void motionStep( servoData_t * s )
+{
+	motionPlan_t	plan;
+
+	if ( s->targetPos != s->motion.goal ) {
+		motionPlan( &s->motion, s->currentPos, s->targetPos, s->maxPos - s->minPos, &plan );
+		motionAdopt( &s->motion, s->currentPos, &plan );
+	}
+	motionAdvance( &s->motion, &s->currentPos );
+}
+//
+// ============================================================================
+// motionAdvance -- Move pos one tic closer to m->goal
+//
+// No divisions, pos always lands exactly on the goal. A phase driven move, an
+// S-curve or any timed one, lands on the tic its phase wraps.
+//
+void motionAdvance( motion_t * m, uint16_t * pos )
+{
+	uint16_t	remaining;
+	uint16_t	step;
+	uint32_t	acc;
+
+	remaining = motionDistance( *pos, m->goal );
+	if ( 0 == remaining ) {
+		m->velocity = 0;
+		return;
+	}
+
+	if ( m->throwTics || (profileSCurve == m->profile) ) {
+		if ( !m->phaseStep || ((uint32_t)(m->phase + m->phaseStep) < m->phase) ) {
+			*pos = m->goal;							// Phase wrapped, the move is done
+			return;
+		}
+		m->phase += m->phaseStep;
+		step = ((uint32_t)motionDistance( m->start, m->goal ) * motionEase( m->profile, m->phase )) >> 15;
+		*pos = ( m->goal > m->start ) ? m->start + step : m->start - step;
+		return;
+	}
+
+	switch ( m->profile ) {
+		case profileTrapezoid:
+			if ( remaining <= m->ramp ) {
+				if ( m->velocity > m->accel )
+					m->velocity -= m->accel;
+			}
+			else if ( m->velocity < m->vMax ) {
+				// Braking steps through the velocities below the one being left,
+				// so ramp grows by the old velocity rather than this tic's step
+				m->ramp += (m->velocity + 0x80) >> 8;
+				m->velocity = ( m->vMax - m->velocity > m->accel ) ? m->velocity + m->accel : m->vMax;
+			}
+			break;
+
+		default:
+			m->velocity = m->vMax;
+			break;
+	}
+
+	acc = (uint32_t)m->frac + m->velocity;
+	step = acc >> 8;
+	m->frac = acc & 0xFF;
+
+	if ( step >= remaining ) {
+		*pos = m->goal;
+		m->velocity = 0;
+		m->frac = 0;
+	}
+	else if ( m->goal > *pos ) {
+		*pos += step;
+	}
+	else {
+		*pos -= step;
+	}
+}
+//
+// ============================================================================
+//
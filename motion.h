@@ -0,0 +1,62 @@
+#ifndef _MOTION_H_
+#define _MOTION_H_
+//
+// ============================================================================
+//
+// motion.h -- Motion profile engine for the servo subsystem
+//
+// ============================================================================
+//
+// profileLinear	-- Constant velocity vMax, the original SERVO_DELTA behaviour
+// profileTrapezoid	-- Accelerate at accel up to vMax, cruise, decelerate at accel
+// profileSCurve	-- Position follows a precomputed easing curve in PROGMEM,
+//					   zero velocity and acceleration at both ends
+//
+// A servo with a throw time, motion_t.throwTics, ignores vMax and accel: a full
+// minPos to maxPos throw takes exactly throwTics, a shorter move (a reversal
+// part way) the same fraction of it. The move is driven by a 32 bit phase that
+// steps by 2^32/tics rounded up, so it wraps on the last tic of the move and
+// no rounding builds up however long the throw. The position is the start plus
+// the distance times an easing curve of the phase: a straight line (linear),
+// the S-curve table, or a trapezoid that ramps over the first and last quarter
+// of the time. Throw times run from MOTION_THROW_MIN_MS to MOTION_THROW_MAX_MS,
+// set with the console 'r' command, and are rounded to whole tics.
+//
+// Per tic, linear and trapezoid moves without a throw time cost a handful of
+// adds and compares. S-curve and timed moves also step the phase, evaluate the
+// easing curve (two table reads and a 16x8 multiply for the S-curve, at most
+// two 16x16 multiplies for the trapezoid, a shift for linear) and scale it to
+// the distance with one 16x16 multiply. Divisions are only done when a move
+// starts, by motionPlan(), which turns a new targetPos into a motionPlan_t.
+// motionAdopt() starts the planned move and motionAdvance() does one tic of
+// it, both at a fixed cost, so with SERVO_ISR_STEP they can run in the timer1
+// frame interrupt while the planning stays in the main loop.
+//
+// Needs servo.h
+//
+#define MOTION_DEFAULT_PROFILE	profileTrapezoid
+#define MOTION_DEFAULT_VMAX		(SERVO_DELTA<<8)	// Q8.8 units/tic
+#define MOTION_DEFAULT_ACCEL	(SERVO_US(1)<<7)	// Q8.8 units/tic/tic, vMax in 16 tics
+//
+#define MOTION_SCURVE_SHIFT		6					// log2 of the S-curve table size
+#define MOTION_SCURVE_ONE		32768				// S-curve table value at the end of a move
+//
+#define MOTION_THROW_MIN_MS		200
+#define MOTION_THROW_MAX_MS		30000
+#define MOTION_THROW_TICS(ms)	(((uint32_t)(ms) * SERVO_HZ + 500) / 1000)	// Nearest tic
+//
+typedef struct {
+	uint16_t	goal;				// targetPos to head for
+	uint16_t	ramp;				// Distance needed to brake from the kept velocity
+	uint32_t	phaseStep;			// Phase increment per tic (S-curve, timed moves)
+	uint8_t		keep;				// Carry on at the present velocity, the same direction
+} motionPlan_t;
+//
+void motionPlan( const motion_t * m, uint16_t pos, uint16_t target, uint16_t span, motionPlan_t * p );	// Plan a move
+void motionAdopt( motion_t * m, uint16_t pos, const motionPlan_t * p );	// Start a planned move from pos
+void motionAdvance( motion_t * m, uint16_t * pos );	// Move pos one tic closer to m->goal
+void motionStep( servoData_t * s );		// Move currentPos one tic closer to targetPos
+//
+// ============================================================================
+//
+#endif	// _MOTION_H_
@@ -4,29 +4,280 @@
 //
 // ============================================================================
 #include <stdint.h>
-#include <avr/eeprom.h>
+#include <stddef.h>
 //
+#include "hal.h"
+#include "servoturnout.h"
 #include "servo.h"
+#include "motion.h"
 #include "rom.h"
 //
+_Static_assert( ROM_CONFIG_SIZE <= ROM_MAX_ADDRESS+1 - 2*ROM_RECORD_SIZE, "board settings leave no room for the journal" );
+_Static_assert( ROM_SLOT_COUNT >= 2, "journal needs at least two slots" );
+_Static_assert( ROM_SCAN_SLOTS <= 32, "romScan() tracks slots in a 32 bit mask" );
+_Static_assert( ROM_QUEUE_SIZE >= ROM_RECORD_SIZE, "write queue must hold a whole record" );
+_Static_assert( (ROM_QUEUE_SIZE & (ROM_QUEUE_SIZE-1)) == 0, "write queue size must be a power of two" );
+//
+#define ROM_QUEUE_MASK		(ROM_QUEUE_SIZE-1)
+//
+volatile uint8_t	eepromUpdateFlag;		// ROM_FLAG_xxx
+uint8_t				romQueueMax;
+uint16_t			romQueueOverflows;
+//
+static uint16_t		romIdleTics;				// Tics left before dirty data is committed
+static uint8_t		romHead = ROM_SLOT_COUNT-1;	// Slot holding the newest record
+static uint16_t		romSeq;						// Sequence number of the newest record
+//
+// Write queue. romQHead is only written by romWrite(), romQTail only by the
+// ISR, both count freely and are masked on use.
+static uint8_t			romQAddr[ROM_QUEUE_SIZE];
+static uint8_t			romQData[ROM_QUEUE_SIZE];
+static volatile uint8_t	romQHead;
+static volatile uint8_t	romQTail;
+//
+// ============================================================================
+// EEPROM_READY -- ISR, write the next queued byte
+//
+// Fires whenever the EEPROM is idle and EERIE is set. A byte that already
+// holds the queued value is dropped without a write cycle and the interrupt
+// fires again at once. When the queue is empty the interrupt disables itself.
+//
+ISR(EEPROM_READY_vect)
+{
+	uint8_t tail = romQTail;
+	uint8_t addr;
+
+	if ( tail == romQHead ) {
+		halEepromIntDisable();
+		eepromUpdateFlag &= ~ROM_FLAG_BUSY;
+		return;
+	}
+
+	addr = romQAddr[tail & ROM_QUEUE_MASK];
+	if ( halEepromRead( addr ) != romQData[tail & ROM_QUEUE_MASK] ) {
+		halEepromWrite( addr, romQData[tail & ROM_QUEUE_MASK] );
+	}
+	romQTail = tail + 1;
+}
+//
+// ============================================================================
+// romQueueDepth -- Number of bytes waiting to be written
+//
+uint8_t romQueueDepth( void )
+{
+	return (uint8_t)(romQHead - romQTail);
+}
+//
+// ============================================================================
+// romConfigRead -- Read a board setting, dflt if it was never written or is torn
+//
+uint8_t romConfigRead( uint8_t addr, uint8_t dflt )
+{
+	uint8_t value = eeprom_read_byte( (uint8_t *)(uintptr_t)addr );
+	uint8_t check = eeprom_read_byte( (uint8_t *)(uintptr_t)(addr + 1) );
+
+	return ( (uint8_t)(value ^ check) == 0xFF ) ? value : dflt;
+}
+//
+// ============================================================================
+// romConfigWrite -- Queue a board setting and its complement
+//
+// return 0 if the queue hadn't room for both bytes, nothing is queued then
+//
+uint8_t romConfigWrite( uint8_t addr, uint8_t value )
+{
+	if ( ROM_QUEUE_SIZE - romQueueDepth() < 2 ) {
+		++romQueueOverflows;
+		return 0;
+	}
+	romWrite( addr, value );
+	romWrite( addr + 1, ~value );
+	return 1;
+}
+//
+// ============================================================================
+// romMotionWrite -- Queue the settings of servo idx that m changes
+//
+// Only the settings that differ from servo[idx].motion, the ones running, are
+// queued. One never written reads as the compiled in default, which is what
+// was running. vMax and accel are stored shifted down, the caller keeps them to
+// the stored resolution so what runs is what comes back after a reset.
+//
+// return 0 if the queue hadn't room for them all, nothing is queued then
+//
+uint8_t romMotionWrite( enum eServo idx, const motion_t * m )
+{
+	const motion_t * was = &servo[idx].motion;
+	uint8_t addr = ROM_ADDR_MOTION( idx );
+	uint8_t need;
+
+	need  = ( m->vMax != was->vMax ) ? 2 : 0;
+	need += ( m->accel != was->accel ) ? 2 : 0;
+	need += ( m->profile != was->profile ) ? 2 : 0;
+	need += ( m->throwTics != was->throwTics ) ? 4 : 0;
+	if ( ROM_QUEUE_SIZE - romQueueDepth() < need ) {
+		++romQueueOverflows;
+		return 0;
+	}
+
+	if ( m->vMax != was->vMax )
+		romConfigWrite( addr + ROM_MOTION_SPEED, m->vMax >> ROM_SPEED_SHIFT );
+	if ( m->accel != was->accel )
+		romConfigWrite( addr + ROM_MOTION_ACCEL, m->accel >> ROM_ACCEL_SHIFT );
+	if ( m->profile != was->profile )
+		romConfigWrite( addr + ROM_MOTION_PROFILE, m->profile );
+	if ( m->throwTics != was->throwTics ) {
+		romConfigWrite( addr + ROM_MOTION_THROW, m->throwTics );
+		romConfigWrite( addr + ROM_MOTION_THROW + 2, m->throwTics >> 8 );
+	}
+	return 1;
+}
+//
+// ============================================================================
+// romMotionLoad -- Load a servo's motion settings over the compiled in defaults
+//
+// A setting that was never written, is torn or is out of range is left alone.
+//
+static void romMotionLoad( enum eServo idx )
+{
+	motion_t * m = &servo[idx].motion;
+	uint8_t addr = ROM_ADDR_MOTION( idx );
+	uint8_t value;
+	uint16_t tics;
+
+	if ( (value = romConfigRead( addr + ROM_MOTION_SPEED, 0 )) )
+		m->vMax = (uint16_t)value << ROM_SPEED_SHIFT;
+	if ( (value = romConfigRead( addr + ROM_MOTION_ACCEL, 0 )) )
+		m->accel = (uint16_t)value << ROM_ACCEL_SHIFT;
+	if ( (value = romConfigRead( addr + ROM_MOTION_PROFILE, 0xFF )) <= profileSCurve )
+		m->profile = value;
+	tics = romConfigRead( addr + ROM_MOTION_THROW, 0xFF ) | ((uint16_t)romConfigRead( addr + ROM_MOTION_THROW + 2, 0xFF ) << 8);
+	if ( (0 == tics) || ((tics >= MOTION_THROW_TICS( MOTION_THROW_MIN_MS )) && (tics <= MOTION_THROW_TICS( MOTION_THROW_MAX_MS ))) )
+		m->throwTics = tics;
+}
+#ifdef SERVO_POSITIONS
+//
+// ============================================================================
+// romStopWrite -- Queue the position of servo idx's stop n
+//
+// return 0 if the queue hadn't room for it, nothing is queued then
+//
+uint8_t romStopWrite( enum eServo idx, uint8_t n, uint16_t pos )
+{
+	uint8_t addr = ROM_ADDR_STOPS( idx ) + ROM_STOPS_POS( n );
+
+	if ( ROM_QUEUE_SIZE - romQueueDepth() < 4 ) {
+		++romQueueOverflows;
+		return 0;
+	}
+	romConfigWrite( addr, pos );
+	romConfigWrite( addr + 2, pos >> 8 );
+	return 1;
+}
 //
 // ============================================================================
-// Structure for the data on the ROM
+// romStopsLoad -- Load servo idx's position table, or the defaults if !saved
+//
+// A stop never written, torn or outside the absolute limits starts at
+// SERVO_DEFAULT_CENTER. The table is loaded whole, the count only says how much
+// of it is used, so a stop removed and added again comes back where it was.
 //
-/*
-typedef struct {
-	uint16_t	signature;			// A signature to insure we got valid data from the ROM
-	uint16_t	eepromversion;		// The version of eeprom data format
-	servoData_t	servoData[SERVO_COUNT];		// Data for individual servos
-} servoEeprom_t;
-*/
+static void romStopsLoad( enum eServo idx, uint8_t saved )
+{
+	servoData_t * s = &servo[idx];
+	uint8_t addr = ROM_ADDR_STOPS( idx );
+	uint8_t count = saved ? romConfigRead( addr + ROM_STOPS_COUNT, 0 ) : 0;
+	uint16_t pos = 0;
+
+	for ( uint8_t n=0; n<SERVO_POSITIONS-2; ++n ) {
+		if ( saved )
+			pos = romConfigRead( addr + ROM_STOPS_POS( n ), 0xFF ) | ((uint16_t)romConfigRead( addr + ROM_STOPS_POS( n ) + 2, 0xFF ) << 8);
+		s->stop[n] = ( (pos >= SERVO_ABSOLUTE_MIN) && (pos <= SERVO_ABSOLUTE_MAX) ) ? pos : SERVO_DEFAULT_CENTER;
+	}
+	s->stops = ( count <= SERVO_POSITIONS-2 ) ? count : 0;
+}
+#endif	// SERVO_POSITIONS
 //
 // ============================================================================
-// romWrite -- Write one word to the appropriate backing store location
+// romConfigAdopt -- Load the servo settings the old layout held, spoil the rest
 //
-void romWrite( uint16_t * addr, uint16_t value )
+// saved is the lowest address that was in the board settings of the firmware
+// that last ran, anything below it was journal. Rewriting a complement with the
+// value itself can never read as valid. The spoiling is queued ahead of the new
+// ROM_ADDR_LAYOUT, which is queued ahead of any record commit.
+//
+static void romConfigAdopt( uint16_t saved )
 {
-	eeprom_update_word( addr, value );
+	uint8_t value;
+
+	if ( saved > ROM_MAX_ADDRESS+1 - ROM_CONFIG_SIZE_V3 )
+		saved = ROM_MAX_ADDRESS+1 - ROM_CONFIG_SIZE_V3;		// A nonsense layout, keep the frog and TWI settings
+
+	for ( uint8_t idx=0; idx<SERVO_COUNT; ++idx ) {
+		if ( ROM_ADDR_MOTION( idx ) >= saved )
+			romMotionLoad( idx );
+#ifdef SERVO_POSITIONS
+		romStopsLoad( idx, ROM_ADDR_STOPS( idx ) >= saved );
+#endif
+	}
+
+	for ( uint16_t addr=ROM_CONFIG_ADDR; addr<saved; addr+=2 ) {
+		value = eeprom_read_byte( (uint8_t *)(uintptr_t)addr );
+		if ( romConfigRead( addr, ~value ) == value )
+			romWrite( addr + 1, value );
+	}
+	if ( (ROM_ADDR_LAYOUT < saved) || (romConfigRead( ROM_ADDR_LAYOUT, 0 ) != ROM_CONFIG_SIZE) )
+		romConfigWrite( ROM_ADDR_LAYOUT, ROM_CONFIG_SIZE );
+}
+//
+// ============================================================================
+// romWrite -- Queue one byte for the EEPROM, never waits
+//
+// return 1 if queued, 0 if the queue was full and the byte was dropped
+//
+uint8_t romWrite( uint8_t addr, uint8_t value )
+{
+	uint8_t head = romQHead;
+	uint8_t depth = romQueueDepth();
+
+	if ( depth >= ROM_QUEUE_SIZE ) {
+		++romQueueOverflows;
+		return 0;
+	}
+
+	romQAddr[head & ROM_QUEUE_MASK] = addr;
+	romQData[head & ROM_QUEUE_MASK] = value;
+	romQHead = head + 1;
+
+	if ( ++depth > romQueueMax )
+		romQueueMax = depth;
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+		eepromUpdateFlag |= ROM_FLAG_BUSY;
+		halEepromIntEnable();
+	}
+
+	return 1;
+}
+//
+// ============================================================================
+// romChecksum -- CRC-8 (polynomial 0x07) over a record, excluding the check byte
+//
+static uint8_t romChecksum( const romRecord_t * rec )
+{
+	const uint8_t * p = (const uint8_t *)rec;
+	uint8_t crc = 0;
+	uint8_t len;
+	uint8_t bit;
+
+	for ( len=0; len<ROM_RECORD_SIZE-1; ++len ) {
+		crc ^= *p++;
+		for ( bit=0; bit<8; ++bit ) {
+			crc = ( crc & 0x80 ) ? (crc<<1) ^ 0x07 : (crc<<1);
+		}
+	}
+
+	return crc;
 }
 //
 // ============================================================================
@@ -43,91 +294,235 @@ uint16_t romCheckRange( uint16_t curValue, uint16_t maxValue, uint16_t minValue
 
 	return curValue;
 }
+//
+// ============================================================================
+// romServoLoad -- Copy one servo's persistent data into the servo structure
+//
+// The stored values are multiplied by scale to convert them to position units.
+// Values are range checked. A servo whose limits have crossed is left with the
+// defaults it was initialized with.
+//
+static void romServoLoad( enum eServo idx, uint16_t minPos, uint16_t maxPos, uint16_t targetPos,
+							uint8_t scale )
+{
+	uint8_t atMax = ( targetPos == maxPos );
+
+	minPos = romCheckRange( minPos, SERVO_ABSOLUTE_MAX/scale, SERVO_ABSOLUTE_MIN/scale ) * scale;
+	maxPos = romCheckRange( maxPos, SERVO_ABSOLUTE_MAX/scale, SERVO_ABSOLUTE_MIN/scale ) * scale;
+
+	if ( minPos < maxPos ) {
+		servo[idx].minPos = minPos;
+		servo[idx].maxPos = maxPos;
+		servo[idx].targetPos = atMax ? maxPos : minPos;
+	}
+	servo[idx].currentPos = servo[idx].targetPos;
+}
+//
+// ============================================================================
+// romScan -- Find the newest valid record in the journal
+//
+// The first pass only reads the sequence number and version of each slot. The
+// winner's checksum is then verified; a torn or corrupt record is excluded and
+// the scan repeated, so a normal boot reads each slot once plus one record.
+// Records of the previous versions are accepted.
+// The scan also covers the slot the board settings have since taken over, so a
+// board whose newest record is there doesn't lose it.
+// A torn newest record is what a power failure during a commit leaves, so it
+// is passed over quietly. ROM_FLAG_ERROR is set only when an older record is
+// corrupt too, or no valid record is left after rejecting one.
+//
+// return 1 and fill *rec iff a valid record was found
+//
+static uint8_t romScan( romRecord_t * rec )
+{
+	uint32_t	rejected = 0;
+	uint8_t		slot;
+	uint8_t		best;
+	uint16_t	seq;
+	uint16_t	bestSeq = 0;
+	uint8_t		ver;
+	uint8_t		torn = 0;
+
+	for ( ;; ) {
+		best = 0xFF;
+		for ( slot=0; slot<ROM_SCAN_SLOTS; ++slot ) {
+			if ( rejected & (1UL<<slot) )
+				continue;
+			ver = eeprom_read_byte( (uint8_t *)(ROM_SLOT_ADDR(slot) + offsetof(romRecord_t, version)) );
+			if ( (ver < ROM_RECORD_VERSION_US) || (ver > ROM_RECORD_VERSION) ) {
+				rejected |= (1UL<<slot);
+				continue;
+			}
+			seq = eeprom_read_word( (uint16_t *)(ROM_SLOT_ADDR(slot) + offsetof(romRecord_t, seq)) );
+			// Serial number arithmetic, the journal never spans more than 32k records
+			if ( (0xFF == best) || ((int16_t)(seq - bestSeq) > 0) ) {
+				best = slot;
+				bestSeq = seq;
+			}
+		}
+
+		if ( 0xFF == best ) {
+			if ( torn )
+				eepromUpdateFlag |= ROM_FLAG_ERROR;
+			return 0;
+		}
+
+		eeprom_read_block( rec, (void *)ROM_SLOT_ADDR(best), ROM_RECORD_SIZE );
+		if ( rec->check == romChecksum( rec ) ) {
+			romHead = best;
+			romSeq = bestSeq;
+			return 1;
+		}
+		rejected |= (1UL<<best);
+		if ( torn++ )
+			eepromUpdateFlag |= ROM_FLAG_ERROR;
+	}
+}
+//
+// ============================================================================
+// romCommit -- Append the current servo data to the journal
+//
+// The record is queued for the slot after the newest one. The checksum is the
+// last byte written so a record torn by a power failure is rejected at boot
+// and the previous record is used instead. If the queue can't take the whole
+// record the data is left marked dirty and romHeartBeat() tries again.
+//
+void romCommit( void )
+{
+	romRecord_t rec;
+	const uint8_t * p;
+	uint8_t idx;
+
+	if ( romQueueDepth() + ROM_RECORD_SIZE > ROM_QUEUE_SIZE ) {
+		ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+			if ( !(eepromUpdateFlag & ROM_FLAG_DIRTY) )
+				++romQueueOverflows;
+			eepromUpdateFlag |= ROM_FLAG_DIRTY;
+		}
+		return;
+	}
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+		eepromUpdateFlag &= ~ROM_FLAG_DIRTY;
+	}
+
+	rec.seq = ++romSeq;
+	for ( idx=0; idx<SERVO_COUNT; ++idx ) {
+		rec.servo[idx].minPos = servo[idx].minPos;
+		rec.servo[idx].maxPos = servo[idx].maxPos;
+		rec.servo[idx].targetPos = servo[idx].targetPos;
+	}
+	rec.version = ROM_RECORD_VERSION;
+	rec.check = romChecksum( &rec );
+
+	if ( ++romHead >= ROM_SLOT_COUNT )
+		romHead = 0;
+	p = (const uint8_t *)&rec;
+	for ( idx=0; idx<ROM_RECORD_SIZE; ++idx ) {
+		romWrite( ROM_SLOT_ADDR(romHead) + idx, *p++ );
+	}
+}
+//
+// ============================================================================
+// romMarkDirty -- Note that the servo data changed without committing it
+//
+// Every call restarts the idle timeout, the data is committed by romHeartBeat()
+// ROM_COMMIT_IDLE_TICS after the last change.
+//
+void romMarkDirty( void )
+{
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+		eepromUpdateFlag |= ROM_FLAG_DIRTY;
+	}
+	romIdleTics = ROM_COMMIT_IDLE_TICS;
+}
+//
+// ============================================================================
+// romHeartBeat -- Periodic service for the backing store
+//
+// Commit dirty data once the idle timeout has run out. A commit that found the
+// queue full leaves the timeout at zero and so is retried on every tic.
+//
+void romHeartBeat( void )
+{
+	if ( eepromUpdateFlag & ROM_FLAG_DIRTY ) {
+		if ( romIdleTics ) {
+			--romIdleTics;
+		}
+		else {
+			romCommit();
+		}
+	}
+}
+//
 // ============================================================================
 // romServoDataInitialize -- Initialize servo data from persistent storage
 //
-// Check ROM signature and version.
-// If correct and current read ROM data into the servo structure
-// If out of date or incorrect, write default data to ROM and servo structure
+// Load the newest journal record into the servo structure, then the servo
+// board settings the layout it was written with held. If there is none, migrate
+// the version 1.0 fixed address layout if its signature is present, otherwise
+// start a new journal with the compiled in defaults. Data from an older record,
+// or found where the board settings now are, is committed again in the current
+// format. With SERVO_POSITIONS a saved target that is one of the stops puts the
+// servo back on that stop.
 // ROM values are range checked and corrected if they are beyond absolute limits
 //
 void romServoDataInitialize( void )
 {
+	romRecord_t rec;
 	uint16_t sig;
 	uint16_t ver;
+	uint16_t saved = ROM_MAX_ADDRESS+1 - ROM_CONFIG_SIZE_V3;
+	uint8_t scale;
 	uint8_t idx;
-	
+
+	if ( romScan( &rec ) ) {
+		scale = ( rec.version == ROM_RECORD_VERSION_US ) ? SERVO_US(1) : 1;
+		for ( idx=0; idx<SERVO_COUNT; ++idx ) {
+			romServoLoad( idx, rec.servo[idx].minPos, rec.servo[idx].maxPos, rec.servo[idx].targetPos, scale );
+		}
+		if ( rec.version == ROM_RECORD_VERSION )
+			saved = ROM_MAX_ADDRESS+1 - romConfigRead( ROM_ADDR_LAYOUT, ROM_CONFIG_SIZE_V4 );
+		else if ( rec.version == ROM_RECORD_VERSION_MOTION )
+			saved = ROM_MAX_ADDRESS+1 - ROM_CONFIG_SIZE_V4;
+		romConfigAdopt( saved );
+#ifdef SERVO_POSITIONS
+		for ( idx=0; idx<SERVO_COUNT; ++idx )
+			servoIndexFind( idx, rec.servo[idx].targetPos * scale );
+#endif
+		if ( (rec.version != ROM_RECORD_VERSION) || (romHead >= ROM_SLOT_COUNT) )
+			romCommit();
+		return;
+	}
+
 	sig = eeprom_read_word( (uint16_t *)ROM_ADDR_SIGNATURE );
 	ver = eeprom_read_word( (uint16_t *)ROM_ADDR_EEVERSION );
 
-	// If signature and version are correct fetch from ROM
-	if ( (sig == SERVO_SIGNATURE) && (ver == SERVO_EEVERSION) ) {
-		// TODO: Add error checking to targetPos and min/maxPos
-		servo[0].targetPos = eeprom_read_word( (uint16_t *)ROM_ADDR_SERVO1_TARGETPOS );
-		servo[0].targetPos = romCheckRange( servo[0].targetPos,
-			   				SERVO_ABSOLUTE_MAX, SERVO_ABSOLUTE_MIN );
-
-		servo[0].minPos = eeprom_read_word( (uint16_t *)ROM_ADDR_SERVO1_MINPOS );
-		servo[0].minPos = romCheckRange( servo[0].minPos,
-			   				SERVO_ABSOLUTE_MAX, SERVO_ABSOLUTE_MIN );
-
-		servo[0].maxPos = eeprom_read_word( (uint16_t *)ROM_ADDR_SERVO1_MAXPOS );
-		servo[0].maxPos = romCheckRange( servo[0].maxPos,
-			   				SERVO_ABSOLUTE_MAX, SERVO_ABSOLUTE_MIN );
-
-		servo[0].currentPos = servo[0].targetPos;
-		servo[0].Pin = SERVO1_PIN;
-			servo[0].targetPos = SERVO_DEFAULT_MIN;
-		//
-		servo[1].targetPos = eeprom_read_word( (uint16_t *)ROM_ADDR_SERVO2_TARGETPOS );
-		servo[1].targetPos = romCheckRange( servo[1].targetPos,
-			   				SERVO_ABSOLUTE_MAX, SERVO_ABSOLUTE_MIN );
-
-		servo[1].minPos = eeprom_read_word( (uint16_t *)ROM_ADDR_SERVO2_MINPOS );
-		servo[1].minPos = romCheckRange( servo[1].minPos,
-			   				SERVO_ABSOLUTE_MAX, SERVO_ABSOLUTE_MIN );
-
-		servo[1].maxPos = eeprom_read_word( (uint16_t *)ROM_ADDR_SERVO2_MAXPOS );
-		servo[1].maxPos = romCheckRange( servo[1].maxPos,
-			   				SERVO_ABSOLUTE_MAX, SERVO_ABSOLUTE_MIN );
-
-		servo[1].currentPos = servo[1].targetPos;
-		servo[1].Pin = SERVO2_PIN;
-		//
-	}
-	else {
-		
-		// Bad signature or version
-		// The servo[] array was initialized at startup
-		// Initialize ROM with default, minPos, maxPos and targetPos
-		//
-/*
-		// Initialize servo data structure with the defaults
-		servo[0].targetPos = SERVO_DEFAULT_MIN;
-		servo[0].minPos = SERVO_DEFAULT_MIN;
-		servo[0].maxPos = SERVO_DEFAULT_MAX;
-		servo[0].currentPos = servo[0].targetPos;
-		servo[0].Pin = SERVO1_PIN;
-		//
-		servo[1].targetPos = SERVO_DEFAULT_MIN;
-		servo[1].minPos = SERVO_DEFAULT_MIN;
-		servo[1].maxPos = SERVO_DEFAULT_MAX;
-		servo[1].currentPos = servo[1].targetPos;
-		servo[1].Pin = SERVO2_PIN;
-*/
-		//
-		// Write signature and version to ROM
-		eeprom_update_word( (uint16_t *)ROM_ADDR_SIGNATURE, ROM_SIGNATURE );
-		eeprom_update_word( (uint16_t *)ROM_ADDR_EEVERSION, ROM_EEVERSION );
-		// Write default servo data to ROM
-		eeprom_update_word( (uint16_t *)ROM_ADDR_SERVO1_MINPOS, SERVO_DEFAULT_MIN );
-		eeprom_update_word( (uint16_t *)ROM_ADDR_SERVO1_MAXPOS, SERVO_DEFAULT_MAX );
-		eeprom_update_word( (uint16_t *)ROM_ADDR_SERVO1_TARGETPOS, SERVO_DEFAULT_MIN );
-
-		eeprom_update_word( (uint16_t *)ROM_ADDR_SERVO2_MINPOS, SERVO_DEFAULT_MIN );
-		eeprom_update_word( (uint16_t *)ROM_ADDR_SERVO2_MAXPOS, SERVO_DEFAULT_MAX );
-		eeprom_update_word( (uint16_t *)ROM_ADDR_SERVO2_TARGETPOS, SERVO_DEFAULT_MIN );
+	// Version 1.0 firmware wrote ROM_EEVERSION but checked for SERVO_EEVERSION, accept either
+	if ( (sig == ROM_SIGNATURE) && ((ver == ROM_EEVERSION) || (ver == SERVO_EEVERSION)) ) {
+		romServoLoad( servo1,
+			eeprom_read_word( (uint16_t *)ROM_ADDR_SERVO1_MINPOS ),
+			eeprom_read_word( (uint16_t *)ROM_ADDR_SERVO1_MAXPOS ),
+			eeprom_read_word( (uint16_t *)ROM_ADDR_SERVO1_TARGETPOS ), SERVO_US(1) );
+		romServoLoad( servo2,
+			eeprom_read_word( (uint16_t *)ROM_ADDR_SERVO2_MINPOS ),
+			eeprom_read_word( (uint16_t *)ROM_ADDR_SERVO2_MAXPOS ),
+			eeprom_read_word( (uint16_t *)ROM_ADDR_SERVO2_TARGETPOS ), SERVO_US(1) );
+		// The old layout lives in slot 0, append the migrated record after it so
+		// a power failure during migration loses nothing. Slot 0's "version" byte
+		// is part of servo2's targetPos and can pass romScan()'s filter with seq
+		// ROM_SIGNATURE, so the journal carries on from there and always wins.
+		romHead = 0;
+		romSeq = ROM_SIGNATURE;
+		eepromUpdateFlag &= ~ROM_FLAG_ERROR;	// Slot 0 failing its checksum is expected
 	}
+
+	// Bad signature or version: the servo[] array was initialized at startup
+	romConfigAdopt( saved );
+#ifdef SERVO_POSITIONS
+	for ( idx=0; idx<SERVO_COUNT; ++idx )
+		servoIndexFind( idx, servo[idx].targetPos );
+#endif
+	romCommit();
 }
 //
 // ============================================================================
@@ -1,11 +1,140 @@
 #ifndef __ROM_H_
 #define __ROM_H_
 //
+// ============================================================================
+//
+// rom.h -- Backing store for the servo data
+//
+// ============================================================================
+//
+// The EEPROM is used as a log-structured ring of fixed size records. Every
+// record is a complete snapshot of the persistent servo data plus a sequence
+// number and a checksum. romCommit() appends a record in the slot after the
+// newest one, so writes are spread evenly over the whole device. At boot the
+// newest valid record is the one with the highest sequence number.
+//
+// The bytes are not written directly. romWrite() puts them in a small RAM
+// queue that the EE_READY interrupt drains one byte per write cycle, so no
+// caller ever waits the ~3.4ms an EEPROM write takes. eepromUpdateFlag tells
+// whether there is servo data still to be queued (ROM_FLAG_DIRTY) and whether
+// the queue is still being written (ROM_FLAG_BUSY).
+//
+// Calibration changes don't need to hit the EEPROM at once. romMarkDirty()
+// only flags the data; romHeartBeat() commits it once no further change has
+// been made for ROM_COMMIT_IDLE_TICS, so a run of BTNPLUS/BTNMINUS presses
+// costs a single record. A throw calls romCommit() which takes any pending
+// changes along with it.
+//
+// The top ROM_CONFIG_SIZE bytes hold board settings outside the journal, each a
+// byte followed by its complement so an erased or torn setting reads as the
+// default. They are written rarely enough not to need wear levelling.
+//
+// Each servo's speed, acceleration, profile and throw time are board settings,
+// ROM_ADDR_MOTION(idx), queued by romMotionWrite() when one is changed. With
+// SERVO_POSITIONS the number of stops and their positions are too, at
+// ROM_ADDR_STOPS(idx).
+//
+// ROM_ADDR_LAYOUT holds the ROM_CONFIG_SIZE of the firmware that last ran, so
+// the settings area can grow from one build to the next: the bytes it has
+// grown over held journal records, not settings. At boot only the settings
+// inside the old size are loaded, any stale byte pair below it that happens to
+// read as valid is spoiled, the compiled in defaults are used and the new size
+// is saved. Journals older than ROM_RECORD_VERSION had no ROM_ADDR_LAYOUT, their
+// size follows from the record version.
+//
+// Needs servo.h for SERVO_COUNT and motion_t.
+//
 void romServoDataInitialize( void );	// Initialize servo data from persistent storage
-void romWrite( uint16_t * address, uint16_t value );	// Write a word to the backing store
+void romCommit( void );					// Queue the current servo data for the journal
+void romMarkDirty( void );				// Servo data changed, commit it once things go quiet
+void romHeartBeat( void );				// Commit dirty data when idle or when the queue has room
+uint8_t romWrite( uint8_t addr, uint8_t value );	// Queue a byte, return 0 if the queue is full
+uint8_t romQueueDepth( void );			// Number of bytes waiting to be written
+uint8_t romConfigRead( uint8_t addr, uint8_t dflt );	// A board setting, dflt if not set
+uint8_t romConfigWrite( uint8_t addr, uint8_t value );	// Queue a board setting, 0 if the queue is full
+uint8_t romMotionWrite( enum eServo idx, const motion_t * m );	// Queue changed motion settings, 0 if full
+#ifdef SERVO_POSITIONS
+uint8_t romStopWrite( enum eServo idx, uint8_t n, uint16_t pos );	// Queue a stop's position, 0 if full
+#endif
+//
+extern uint8_t	romQueueMax;			// Deepest the write queue has been
+extern uint16_t	romQueueOverflows;		// Writes and commits refused because the queue was full
 //
 #define ROM_MAX_ADDRESS				255
 //
+// Board settings, ROM_ADDR_xxx is the value and ROM_ADDR_xxx+1 its complement.
+// New settings go below the existing ones so those stay where they are.
+#define ROM_CONFIG_SIZE				(ROM_CONFIG_SIZE_V4 + 2 + ROM_STOPS_SIZE*SERVO_COUNT)
+#define ROM_CONFIG_SIZE_V4			(ROM_CONFIG_SIZE_V3 + ROM_MOTION_SIZE*SERVO_COUNT)	// Record version 4
+#define ROM_CONFIG_SIZE_V3			(2 + 2*SERVO_COUNT)		// Record versions 3 and before
+#define ROM_CONFIG_ADDR				(ROM_MAX_ADDRESS+1-ROM_CONFIG_SIZE)
+#define ROM_ADDR_TWI				(ROM_MAX_ADDRESS+1-2)	// TWI slave address
+#define ROM_ADDR_FROG(idx)			(ROM_ADDR_TWI - 2*SERVO_COUNT + 2*(idx))	// Frog relay switch point
+#define ROM_ADDR_MOTION(idx)		(ROM_ADDR_FROG(0) - ROM_MOTION_SIZE*(SERVO_COUNT-(idx)))	// Motion settings
+#define ROM_ADDR_LAYOUT				(ROM_ADDR_MOTION(0) - 2)	// ROM_CONFIG_SIZE
+#define ROM_ADDR_STOPS(idx)			(ROM_CONFIG_ADDR + ROM_STOPS_SIZE*(idx))	// Position table
+//
+// Motion settings, offsets from ROM_ADDR_MOTION(idx)
+#define ROM_MOTION_SPEED			0			// motion_t.vMax >> ROM_SPEED_SHIFT
+#define ROM_MOTION_ACCEL			2			// motion_t.accel >> ROM_ACCEL_SHIFT
+#define ROM_MOTION_PROFILE			4			// motion_t.profile
+#define ROM_MOTION_THROW			6			// motion_t.throwTics, low byte then high byte
+#define ROM_MOTION_SIZE				10
+#define ROM_SPEED_SHIFT				8			// Whole units per tic, 6.25us/s
+#define ROM_ACCEL_SHIFT				4			// 1/16 unit per tic per tic, ~19.5us/s^2
+//
+// Position table settings, offsets from ROM_ADDR_STOPS(idx)
+#define ROM_STOPS_COUNT				0			// servoData_t.stops
+#define ROM_STOPS_POS(n)			(2 + 4*(n))	// servoData_t.stop[n], low byte then high byte
+#ifdef SERVO_POSITIONS
+#define ROM_STOPS_SIZE				ROM_STOPS_POS( SERVO_POSITIONS-2 )
+#else
+#define ROM_STOPS_SIZE				0
+#endif
+#if SERVO_COUNT > 4
+#define ROM_QUEUE_SIZE				64			// Power of two, at least one record
+#else
+#define ROM_QUEUE_SIZE				32
+#endif
+//
+#ifndef ROM_COMMIT_IDLE_TICS
+#define ROM_COMMIT_IDLE_TICS		(5*SERVO_HZ)	// Commit dirty data after 5s without changes
+#endif
+//
+// eepromUpdateFlag bits
+#define ROM_FLAG_DIRTY				0x01		// Servo data changed but not yet queued
+#define ROM_FLAG_BUSY				0x02		// Write queue not empty or write in progress
+#define ROM_FLAG_ERROR				0x04		// Journal corrupt beyond a torn newest record, until reset
+//
+// ============================================================================
+// Journal record
+//
+typedef struct {
+	uint16_t	minPos;
+	uint16_t	maxPos;
+	uint16_t	targetPos;
+} romServo_t;
+//
+typedef struct {
+	uint16_t	seq;				// Incremented for every record appended
+	romServo_t	servo[SERVO_COUNT];	// Persistent part of servoData_t
+	uint8_t		version;			// ROM_RECORD_VERSION
+	uint8_t		check;				// CRC-8 over all the preceding bytes
+} romRecord_t;
+//
+#define ROM_RECORD_VERSION			5			// Board settings size in ROM_ADDR_LAYOUT
+#define ROM_RECORD_VERSION_MOTION	4			// Motion settings in the board settings
+#define ROM_RECORD_VERSION_UNITS	3			// Positions in SERVO_UNITS_PER_US units, migrated at boot
+#define ROM_RECORD_VERSION_US		2			// Positions in whole us, migrated at boot
+#define ROM_RECORD_SIZE				(sizeof(romRecord_t))
+#define ROM_SLOT_COUNT				(ROM_CONFIG_ADDR/ROM_RECORD_SIZE)
+#define ROM_SCAN_SLOTS				((ROM_MAX_ADDRESS+1)/ROM_RECORD_SIZE)	// Before the settings
+#define ROM_SLOT_ADDR(slot)			((slot)*ROM_RECORD_SIZE)
+//
+// ============================================================================
+// Version 1.0 fixed address layout, positions in whole us. Only read, to migrate
+// boards programmed before the journal existed.
+//
 #define ROM_SIGNATURE				0x4545		// "EE"
 #define ROM_MAJOR_VERSION			1
 #define ROM_MINOR_VERSION			0
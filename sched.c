@@ -0,0 +1,86 @@
+//
+// ============================================================================
+//
+// sched.c -- Cooperative task scheduler for the servoturnout program
+//
+// ============================================================================
+//
+#include <stdint.h>
+#include <stddef.h>
+//
+#include "hal.h"
+#include "servoturnout.h"
+//
+#include "sched.h"
+//
+// ============================================================================
+//
+#ifdef SCHED_STATS
+uint16_t		schedWorst[SCHED_TASK_MAX];
+#endif
+static uint8_t	schedDue[SCHED_TASK_MAX];		// Tics until each task next runs
+//
+// ============================================================================
+// schedInit -- Start every task's countdown at its phase
+//
+void schedInit( void )
+{
+	for ( uint8_t idx=0; pgm_read_ptr( &schedTasks[idx].run ); ++idx )
+		schedDue[idx] = pgm_read_byte( &schedTasks[idx].phase );
+}
+#ifdef SCHED_STATS
+//
+// ============================================================================
+// schedAccount -- Keep the longest run of a task
+//
+// Timer1 wraps every PWM period, which is longer than any one task.
+//
+static void schedAccount( uint8_t idx, uint16_t start )
+{
+	uint16_t	now = halTimer1Count();
+	uint16_t	took;
+
+	took = ( now >= start ) ? now - start : now + (ICR1 + 1) - start;
+	if ( took > schedWorst[idx] )
+		schedWorst[idx] = took;
+}
+#endif	// SCHED_STATS
+//
+// ============================================================================
+// schedRun -- Run the tasks due on this pass of the main loop
+//
+// The polled tasks run on every pass, the periodic ones only when tic is set
+// and their countdown has run out.
+//
+void schedRun( uint8_t tic )
+{
+	void		(*run)( void );
+	uint8_t		period;
+#ifdef SCHED_STATS
+	uint16_t	start;
+#endif
+
+	for ( uint8_t idx=0; (run = pgm_read_ptr( &schedTasks[idx].run )); ++idx ) {
+		period = pgm_read_byte( &schedTasks[idx].period );
+		if ( period ) {
+			if ( !tic )
+				continue;
+			if ( schedDue[idx] ) {
+				--schedDue[idx];
+				continue;
+			}
+			schedDue[idx] = period - 1;
+		}
+
+#ifdef SCHED_STATS
+		start = halTimer1Count();
+#endif
+		run();
+#ifdef SCHED_STATS
+		schedAccount( idx, start );
+#endif
+	}
+}
+//
+// ============================================================================
+//
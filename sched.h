@@ -0,0 +1,51 @@
+#ifndef _SCHED_H_
+#define _SCHED_H_
+//
+// ============================================================================
+//
+// sched.h -- Cooperative task scheduler for the servoturnout program
+//
+// ============================================================================
+//
+// The main loop is a static table of run-to-completion tasks, schedTasks[] in
+// servoturnout.c, walked in order by schedRun() on every pass of the loop:
+//	- A task with period 0 runs on every pass, for the polled inputs that act
+//	  as soon as something arrives.
+//	- A task with period n runs on one heartbeat tic in n, starting on tic
+//	  phase. Tasks with the same period and different phases never share a
+//	  tic, so work that doesn't need every tic can be spread out.
+// No task waits or sleeps. The loop sleeps only when a pass found no tic, so a
+// task starts on the tic's first pass after every task ahead of it in the
+// table. In servoturnout.c only the polled inputs (console, DCC, TWI), which
+// each handle what arrived since the last pass, and the button task are ahead
+// of the servo task, so the servos start within those few task times of the
+// heartbeat, whatever else is built in after them.
+//
+// The table ends with a NULL task and holds no more than SCHED_TASK_MAX. A
+// task's countdown to its next run is its only RAM.
+//
+// With SCHED_STATS, the time each task takes is measured with timer1 and the
+// longest kept in schedWorst[], in timer1 counts (1us, 1/8us with
+// SERVO_HIRES), in table order. Costs 2 bytes of SRAM per task.
+//
+// Needs servoturnout.h
+//
+#define SCHED_TASK_MAX		12
+//
+typedef struct {
+	void	(*run)( void );
+	uint8_t	period;				// Tics between runs, 0 for every pass of the loop
+	uint8_t	phase;				// First tic it runs on, less than period
+} schedTask_t;
+//
+extern const schedTask_t schedTasks[] PROGMEM;	// The task table, see servoturnout.c
+#ifdef SCHED_STATS
+extern uint16_t	schedWorst[SCHED_TASK_MAX];		// Longest run of each task, timer1 counts
+#endif
+//
+void schedInit( void );				// Start every task's countdown at its phase
+void schedRun( uint8_t tic );		// One pass of the loop, tic set if a heartbeat was taken
+//
+// ============================================================================
+//
+#endif	// _SCHED_H_
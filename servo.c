@@ -6,111 +6,196 @@
 // ============================================================================
 //
 #include <stdint.h>
-//#include <avr/eeprom.h>
-#include <avr/pgmspace.h>
 //
+#include "hal.h"
 #include "servoturnout.h"
 //
 #include "servo.h"
+#include "motion.h"
 #include "led.h"
 #include "rom.h"
+#include "servomux.h"
 // ============================================================================
+#define SERVO_INIT(pin)		{ .targetPos = SERVO_DEFAULT_MIN, .minPos = SERVO_DEFAULT_MIN, \
+									.maxPos = SERVO_DEFAULT_MAX, .currentPos = SERVO_DEFAULT_MIN, .Pin = (pin), \
+									.motion = { .profile = MOTION_DEFAULT_PROFILE, .vMax = MOTION_DEFAULT_VMAX, \
+												.accel = MOTION_DEFAULT_ACCEL } }
+
 servoData_t servo[SERVO_COUNT] = {
-	{ SERVO_DEFAULT_MIN, SERVO_DEFAULT_MIN, SERVO_DEFAULT_MAX, SERVO_DEFAULT_MIN, SERVO1_PIN },
-	{ SERVO_DEFAULT_MIN, SERVO_DEFAULT_MIN, SERVO_DEFAULT_MAX, SERVO_DEFAULT_MIN, SERVO2_PIN },
+	SERVO_INIT( SERVO_PIN( ePORTB, SERVO1_PIN ) ),
+	SERVO_INIT( SERVO_PIN( ePORTB, SERVO2_PIN ) ),
+#if SERVO_COUNT > 2
+	SERVO_INIT( SERVO3_PIN ),
+#endif
+#if SERVO_COUNT > 3
+	SERVO_INIT( SERVO4_PIN ),
+#endif
+#if SERVO_COUNT > 4
+	SERVO_INIT( SERVO5_PIN ),
+#endif
+#if SERVO_COUNT > 5
+	SERVO_INIT( SERVO6_PIN ),
+#endif
+#if SERVO_COUNT > 6
+	SERVO_INIT( SERVO7_PIN ),
+#endif
+#if SERVO_COUNT > 7
+	SERVO_INIT( SERVO8_PIN ),
+#endif
 };		// Data for each servo
 
 uint8_t	lastServo = 0xFF;			// Last servo that had a button press
 //
+// Whether a servo's target is its min or max table entry, rather than a stop
+#ifdef SERVO_POSITIONS
+#define SERVO_AT_MIN(s)		(0 == (s)->index)
+#define SERVO_AT_MAX(s)		((s)->index > (s)->stops)
+#else
+#define SERVO_AT_MIN(s)		((s)->targetPos == (s)->minPos)
+#define SERVO_AT_MAX(s)		((s)->targetPos == (s)->maxPos)
+#endif
+
+volatile uint8_t servoOutputs = (1<<COM1A1) | (1<<COM1B1);	// Attached OC1x outputs
+uint16_t servoAttachCount;			// Outputs re-armed for a move
+uint16_t servoDetachCount;			// Outputs released after settling
+#ifdef SERVO_ISR_STEP
+#ifdef SERVO_MUX
+#error "SERVO_ISR_STEP writes OCR1A/OCR1B, SERVO_MUX has no hardware PWM outputs"
+#endif
+volatile uint8_t servoFrames;		// Frames stepped by servoFrame(), modulo 256
+static volatile uint16_t servoFramePos[SERVO_COUNT];	// Position servoFrame() sent, owned by it
+static motionPlan_t servoPlan[SERVO_COUNT];	// Move handed to servoFrame()
+static volatile uint8_t servoPlanFull[SERVO_COUNT];	// Set by servoMove(), cleared by servoFrame()
+#endif
+//
 // ============================================================================
 // servoPWMSet -- Set the new PWM value for the  servo
 //
+// With SERVO_MUX the pulses come from the schedule, servoMove() rebuilds it.
+//
 void servoPWMSet( enum eServo idx )
 {
+#if defined( SERVO_MUX ) || defined( SERVO_ISR_STEP )
+	(void)idx;
+#else
 	if ( servo1 == idx ) {
-		OCR1A = servo[idx].currentPos;
+		OCR1A = SERVO_PWM( servo[idx].currentPos );
 	}
 	else if ( servo2 == idx ) {
-		OCR1B = servo[idx].currentPos;
+		OCR1B = SERVO_PWM( servo[idx].currentPos );
 	}
+#endif
 }
+#if SERVO_SETTLE_TICS
 //
 // ============================================================================
-// servoUpdateMinPos -- Update minPos in the servo data structure and in ROM
+// servoOutput -- Attach or release the output of a servo without a glitch pulse
+//
+// OC1x is only changed by the waveform generator while connected, so once it
+// is disconnected after a compare match it stays low. Releasing is therefore
+// left to the compare ISR, after the pulse in progress has ended, and
+// reconnecting at any time only starts pulsing at the next BOTTOM. With
+// SERVO_HIRES the gating ISRs reconnect the outputs in servoOutputs. With
+// SERVO_MUX a released servo is left out of the schedule by muxUpdate().
 //
-static void servoUpdateMinPos( enum eServo idx, uint16_t newPos )
+static void servoOutput( enum eServo idx, uint8_t on )
 {
-	uint16_t * addr;
+#ifdef SERVO_MUX
+	(void)idx;
+	(void)on;
+#else
+	uint8_t com = ( servo1 == idx ) ? (1<<COM1A1) : (1<<COM1B1);
 
-	if ( servo1 == idx )
-		addr = (uint16_t *)ROM_ADDR_SERVO1_MINPOS;
-	else
-		addr = (uint16_t *)ROM_ADDR_SERVO2_MINPOS;
-	romWrite( addr, newPos );
-
-	servo[idx].minPos = newPos;
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+		if ( on ) {
+			servoOutputs |= com;
+#ifndef SERVO_HIRES
+			TCCR1A |= com;
+#endif
+		}
+		else {
+			servoOutputs &= ~com;
+#ifndef SERVO_HIRES
+			TIFR = ( servo1 == idx ) ? (1<<OCF1A) : (1<<OCF1B);
+			TIMSK |= ( servo1 == idx ) ? (1<<OCIE1A) : (1<<OCIE1B);
+#endif
+		}
+	}
+#endif
 }
+#endif	// SERVO_SETTLE_TICS
 //
 // ============================================================================
-// servoUpdateMaxPos -- Update maxPos in the servo data structure and in ROM
+// servoSettle -- Release a servo's output once it has settled, re-arm it to move
+//
+// pos is currentPos before this tic's step. Returns non-zero when the output
+// was attached or released.
 //
-static void servoUpdateMaxPos( enum eServo idx, uint16_t newPos )
+static uint8_t servoSettle( enum eServo idx, uint16_t pos )
 {
-	uint16_t * addr;
+#if SERVO_SETTLE_TICS
+	servoData_t * s = &servo[idx];
 
-	if ( servo1 == idx )
-		addr = (uint16_t *)ROM_ADDR_SERVO1_MAXPOS;
-	else
-		addr = (uint16_t *)ROM_ADDR_SERVO2_MAXPOS;
-	romWrite( addr, newPos );
-
-	servo[idx].maxPos = newPos;
+	if ( (pos != s->currentPos) || (s->currentPos != s->targetPos) ) {
+		if ( s->settle >= SERVO_SETTLE_TICS ) {
+			servoOutput( idx, 1 );
+			++servoAttachCount;
+			s->settle = 0;
+			return 1;
+		}
+		s->settle = 0;
+	}
+	else if ( s->settle < SERVO_SETTLE_TICS ) {
+		if ( ++s->settle >= SERVO_SETTLE_TICS ) {
+			servoOutput( idx, 0 );
+			++servoDetachCount;
+			return 1;
+		}
+	}
+#else
+	(void)idx;
+	(void)pos;
+#endif
+	return 0;
 }
 //
 // ============================================================================
-// servoUpdateTargetPos -- Update targetPos in the servo data structure and in ROM
+// servoLEDShow -- Show one servo's state on its pair of LEDs
+//
+// The LED at the servo's current end is lit. The LED of the end it is heading
+// for breathes while it moves, and blinks fast while a limit change to it is
+// waiting to be saved.
 //
-static void servoUpdateTargetPos( enum eServo idx, uint16_t newPos )
+static void servoLEDShow( enum eServo idx, enum eLED ledA, enum eLED ledB )
 {
-	uint16_t * addr;
+	const servoData_t * s = &servo[idx];
+	enum eLEDPattern pattern = ledSteady;
 
-	if ( servo1 == idx )
-		addr = (uint16_t *)ROM_ADDR_SERVO1_TARGETPOS;
-	else
-		addr = (uint16_t *)ROM_ADDR_SERVO2_TARGETPOS;
-	romWrite( addr, newPos );
+	if ( (idx == lastServo) && (eepromUpdateFlag & ROM_FLAG_DIRTY) )
+		pattern = ledCalibrating;
+	else if ( s->currentPos != s->targetPos )
+		pattern = ledMoving;
 
-	servo[idx].targetPos = newPos;
+	ledSet( ledA, s->currentPos == s->minPos );
+	ledSet( ledB, s->currentPos == s->maxPos );
+	ledPattern( ledA, (s->targetPos == s->minPos) ? pattern : ledSteady );
+	ledPattern( ledB, (s->targetPos == s->maxPos) ? pattern : ledSteady );
 }
 //
 // ============================================================================
 // servoLEDSet -- Set LEDs associated with this servo in accordance with the current state
-// Servo moving: LDxA off, LDxB off
+// Servo moving:	LDxA off, LDxB off, target end LED breathing
 // Servo at minPos	LDxA on, LDxB off
 // Servo at maxPos	LDxA off, LDxB on
 void servoLEDSet( enum eServo idx )
 {
 	switch ( idx ) {
 		case servo1:
-			ledOff( LD1A );
-			ledOff( LD1B );
-			if ( servo[idx].currentPos == servo[idx].minPos ) {
-				ledOn ( LD1A );
-			}
-			else if ( servo[idx].currentPos == servo[idx].maxPos ) {
-				ledOn ( LD1B );
-			}
+			servoLEDShow( idx, LD1A, LD1B );
 			break;
 
 		case servo2:
-			ledOff( LD2A );
-			ledOff( LD2B );
-			if ( servo[idx].currentPos == servo[idx].minPos ) {
-				ledOn ( LD2A );
-			}
-			else if ( servo[idx].currentPos == servo[idx].maxPos ) {
-				ledOn ( LD2B );
-			}
+			servoLEDShow( idx, LD2A, LD2B );
 			break;
 
 		default:
@@ -119,53 +204,350 @@ void servoLEDSet( enum eServo idx )
 
 }
 //
+#ifdef SERVO_ISR_STEP
 // ============================================================================
-// servoMove -- increment/decrement the currentPos of each servo that is in motion
+// servoFrameInit -- Start the frame ISR's positions at currentPos
+//
+// Call once the servo data has been loaded and before the frame ISR runs.
+//
+void servoFrameInit( void )
+{
+	for ( uint8_t idx=0; idx<SERVO_COUNT; ++idx ) {
+		servoFramePos[idx] = servo[idx].currentPos;
+		servo[idx].motion.goal = servo[idx].currentPos;
+	}
+}
+//
+// ============================================================================
+// servoFrame -- Step each servo one frame along its planned move
+//
+// Called from the timer1 ISR at the start of every PWM frame, whatever the
+// main loop is doing. A plan servoMove() has handed over is started first.
+// The cost is fixed: one motionAdopt() when there is a new plan and one
+// motionAdvance() per servo, no divisions. The OCR1x values written here are
+// latched at the start of the next frame.
+//
+void servoFrame( void )
+{
+	uint16_t	pos;
+
+	for ( uint8_t idx=0; idx<SERVO_COUNT; ++idx ) {
+		pos = servoFramePos[idx];
+		if ( servoPlanFull[idx] ) {
+			motionAdopt( &servo[idx].motion, pos, &servoPlan[idx] );
+			servoPlanFull[idx] = 0;			// The slot is servoMove()'s again
+		}
+		motionAdvance( &servo[idx].motion, &pos );
+		servoFramePos[idx] = pos;
+	}
+	OCR1A = SERVO_PWM( servoFramePos[servo1] );
+	OCR1B = SERVO_PWM( servoFramePos[servo2] );
+	++servoFrames;
+}
+//
+// ============================================================================
+// servoMove -- Follow the frame ISR and hand it new targets
+//
+// servo[].motion belongs to servoFrame(), it is copied and the copy checked
+// against servoFrames, so a frame that ran in the middle is seen and the copy
+// made again, rather than turning interrupts off. A new targetPos is planned
+// here, with the divisions, and put in the servo's plan slot, which
+// servoPlanFull hands over: servoMove() only writes the slot while the flag is
+// clear, servoFrame() only reads it while it is set. A target that changes
+// again before the last plan was taken is planned on a later tic. halBarrier()
+// keeps the compiler from moving the plain accesses across either handshake.
+//
+// currentPos is a copy of the ISR's position taken once per tic, so the rest of
+// the program sees it as before.
+//
 void servoMove( void )
 {
-	enum eServo idx;
+	motion_t	snap;
+	uint16_t	now;
+	uint16_t	pos;
+	uint8_t		frame;
 
-// TODO: Add a hook here to disable servo when idle and enable when active...
+	for ( enum eServo idx=0; idx<SERVO_COUNT; ++idx ) {
+		do {
+			frame = servoFrames;
+			halBarrier();				// Copy the plain struct after the first read ...
+			snap = servo[idx].motion;
+			now = servoFramePos[idx];
+			halBarrier();				// ... and finish it before the second
+		} while ( frame != servoFrames );
 
-	for (idx=0; idx<SERVO_COUNT; ++idx ) {
-		// Apply delta to each turnout that is in motion
-		if ( servo[idx].currentPos < servo[idx].targetPos ) {
-			servo[idx].currentPos += SERVO_DELTA;
-			// Check for overshoot
-			if ( servo[idx].currentPos > servo[idx].targetPos )
-				servo[idx].currentPos = servo[idx].targetPos;
-		}
-		else if ( servo[idx].currentPos > servo[idx].targetPos ) {
-			servo[idx].currentPos -= SERVO_DELTA;
-			// Check for undershoot
-			if ( servo[idx].currentPos < servo[idx].targetPos )
-				servo[idx].currentPos = servo[idx].targetPos;
+		pos = servo[idx].currentPos;
+		servo[idx].currentPos = now;
+		if ( !servoPlanFull[idx] && (servo[idx].targetPos != snap.goal) ) {
+			motionPlan( &snap, now, servo[idx].targetPos, servo[idx].maxPos - servo[idx].minPos, &servoPlan[idx] );
+			halBarrier();					// The plan is complete before the flag hands it over
+			servoPlanFull[idx] = 1;			// The slot is servoFrame()'s until it clears this
 		}
+		servoSettle( idx, pos );	// Release idle servos, re-arm moving ones
+		servoLEDSet( idx );
+	}
+}
+#else	// SERVO_ISR_STEP
+// ============================================================================
+// servoMove -- move the currentPos of each servo that is in motion
+void servoMove( void )
+{
+	enum eServo idx;
+	uint16_t pos;
+#ifdef SERVO_MUX
+	uint8_t moved = 0;
+#endif
+
+	for (idx=0; idx<SERVO_COUNT; ++idx ) {
+		pos = servo[idx].currentPos;
+		// Step each turnout that is in motion along its motion profile
+		motionStep( &servo[idx] );
+#ifdef SERVO_MUX
+		moved |= ( pos != servo[idx].currentPos );
+		moved |= servoSettle( idx, pos );	// Release idle servos, re-arm moving ones
+#else
+		servoSettle( idx, pos );	// Release idle servos, re-arm moving ones
+#endif
 		servoPWMSet( idx );		// Write currentPos to the control register
 		servoLEDSet( idx );
 		// Set/Reset the LED
 	}
+#ifdef SERVO_MUX
+	if ( moved )
+		muxUpdate();			// Sort the new positions into the pulse schedule
+#endif
 }
+#endif	// SERVO_ISR_STEP
 // ============================================================================
 // servoToggle -- Reverse servo position
 //
 void servoToggle( enum eServo idx )
 {
-	uint16_t newPos;
+#ifdef SERVO_POSITIONS
+	servoStep( idx, 0 );	// Forward through the table, min and max alone is a reversal
+#else
+	servoSelect( idx, servo[idx].targetPos != servo[idx].maxPos );
 
+	lastServo = idx;		// Store index of most recent servo
+#endif
+}
+//
+// ============================================================================
+// servoSelect -- Send a servo to its max position (toMax) or its min position
+//
+// Nothing is done, and nothing written to the journal, if it is already
+// heading there. Repeated commands, as DCC sends them, cost nothing.
+//
+// return non-zero if the target changed
+//
+uint8_t servoSelect( enum eServo idx, uint8_t toMax )
+{
+	uint16_t newPos = toMax ? servo[idx].maxPos : servo[idx].minPos;
+
+#ifdef SERVO_POSITIONS
+	servo[idx].index = toMax ? servo[idx].stops + 1 : 0;
+#endif
+	if ( servo[idx].targetPos == newPos )
+		return 0;
 
-	if ( servo[idx].targetPos == servo[idx].maxPos ) {
-		newPos = servo[idx].minPos;
+	servo[idx].targetPos = newPos;
+	romCommit();			// One journal record per throw, includes pending limit changes
+	return 1;
+}
+//
+// ============================================================================
+// servoSetLimit -- Set servo idx's min or max position to pos
+//
+// Same rules as servoWiden()/servoNarrow(): inside the absolute limits and
+// never crossing the other limit. A servo sitting at the old limit follows it.
+//
+// return non-zero if the limit was accepted
+//
+uint8_t servoSetLimit( enum eServo idx, uint16_t pos, uint8_t isMax )
+{
+	servoData_t * s = &servo[idx];
+
+	if ( (pos < SERVO_ABSOLUTE_MIN) || (pos > SERVO_ABSOLUTE_MAX) )
+		return 0;
+
+	if ( isMax ) {
+		if ( pos <= s->minPos )
+			return 0;
+		if ( SERVO_AT_MAX( s ) )
+			s->targetPos = pos;
+		s->maxPos = pos;
 	}
 	else {
-		newPos = servo[idx].maxPos;
+		if ( pos >= s->maxPos )
+			return 0;
+		if ( SERVO_AT_MIN( s ) )
+			s->targetPos = pos;
+		s->minPos = pos;
 	}
-	servoUpdateTargetPos( idx, newPos );
+	romMarkDirty();
+	return 1;
+}
+//
+// ============================================================================
+// servoSetMotion -- Set servo idx's speed, acceleration, profile and throw time
+//
+// Takes vMax, accel, profile and throwTics from m and saves them in the EEPROM
+// board settings. vMax and accel are cut to the resolution they are stored at,
+// a zero or one too large to store is refused. With SERVO_ISR_STEP the frame
+// ISR reads them, so they are changed together with interrupts off.
+//
+// return non-zero if the settings were accepted and queued
+//
+uint8_t servoSetMotion( enum eServo idx, const motion_t * m )
+{
+	motion_t * to = &servo[idx].motion;
+	motion_t set = *m;
 
-	lastServo = idx;		// Store index of most recent servo
+	set.vMax &= ~((1<<ROM_SPEED_SHIFT) - 1);
+	set.accel &= ~((1<<ROM_ACCEL_SHIFT) - 1);
+	if ( !set.vMax || !set.accel || (set.accel >> ROM_ACCEL_SHIFT > 0xFF) || (set.profile > profileSCurve) )
+		return 0;
+	if ( !romMotionWrite( idx, &set ) )
+		return 0;
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+		to->vMax = set.vMax;
+		to->accel = set.accel;
+		to->profile = set.profile;
+		to->throwTics = set.throwTics;
+	}
+	return 1;
+}
+#ifdef SERVO_POSITIONS
+//
+// ============================================================================
+// servoPosition -- Position of entry index in servo s's table
+//
+static uint16_t servoPosition( const servoData_t * s, uint8_t index )
+{
+	if ( 0 == index )
+		return s->minPos;
+	if ( index > s->stops )
+		return s->maxPos;
+	return s->stop[index-1];
+}
+//
+// ============================================================================
+// servoGoTo -- Send a servo to entry index of its table
+//
+// A throw commits the journal, as servoSelect() does, and makes idx the servo
+// BTNPLUS/BTNMINUS adjust.
+//
+// return 0, with nothing changed, if the table has no such entry
+//
+uint8_t servoGoTo( enum eServo idx, uint8_t index )
+{
+	servoData_t * s = &servo[idx];
+
+	if ( index > s->stops + 1 )
+		return 0;
+
+	lastServo = idx;
+	s->index = index;
+	if ( s->targetPos != servoPosition( s, index ) ) {
+		s->targetPos = servoPosition( s, index );
+		romCommit();
+	}
+	return 1;
+}
+//
+// ============================================================================
+// servoStep -- Send a servo to the next entry of its table, or the previous one
+//
+// Wraps round at both ends.
+//
+void servoStep( enum eServo idx, uint8_t back )
+{
+	uint8_t last = servo[idx].stops + 1;
+	uint8_t index = servo[idx].index;
+
+	if ( back )
+		index = index ? index - 1 : last;
+	else
+		index = ( index < last ) ? index + 1 : 0;
+	servoGoTo( idx, index );
+}
+//
+// ============================================================================
+// servoSetStops -- Set how many stops servo idx's table uses and save it
+//
+// A servo at maxPos stays there. One on a stop that is no longer used goes to
+// maxPos.
+//
+// return 0, with nothing changed, if there are too many or the EEPROM queue
+// hadn't room
+//
+uint8_t servoSetStops( enum eServo idx, uint8_t stops )
+{
+	servoData_t * s = &servo[idx];
+
+	if ( (stops > SERVO_POSITIONS-2) || !romConfigWrite( ROM_ADDR_STOPS( idx ) + ROM_STOPS_COUNT, stops ) )
+		return 0;
+
+	if ( SERVO_AT_MAX( s ) )
+		s->index = stops + 1;
+	s->stops = stops;
+	if ( s->index > stops )
+		servoGoTo( idx, stops + 1 );
+	return 1;
+}
+//
+// ============================================================================
+// servoSetPosition -- Move the table entry servo idx is at to pos
+//
+// minPos and maxPos follow the servoSetLimit() rules and are committed with the
+// journal, a stop only has to be inside the absolute limits and is saved in
+// the board settings at once. The servo follows, its new targetPos is committed
+// with the journal like a limit change.
+//
+// return non-zero if the position was accepted
+//
+uint8_t servoSetPosition( enum eServo idx, uint16_t pos )
+{
+	servoData_t * s = &servo[idx];
+
+	if ( SERVO_AT_MIN( s ) || SERVO_AT_MAX( s ) )
+		return servoSetLimit( idx, pos, SERVO_AT_MAX( s ) );
+
+	if ( (pos < SERVO_ABSOLUTE_MIN) || (pos > SERVO_ABSOLUTE_MAX) || !romStopWrite( idx, s->index - 1, pos ) )
+		return 0;
+	s->stop[s->index - 1] = pos;
+	s->targetPos = pos;
+	romMarkDirty();			// So the journal's targetPos still finds the stop
+	return 1;
 }
 //
 // ============================================================================
+// servoIndexFind -- Point servo idx's index at the entry a saved target is
+//
+// Called once the servo data and the table have been loaded, target is the
+// position the journal had. targetPos is then minPos or maxPos, a target on a
+// stop moves it, and currentPos, to the stop.
+//
+void servoIndexFind( enum eServo idx, uint16_t target )
+{
+	servoData_t * s = &servo[idx];
+
+	s->index = ( s->targetPos == s->maxPos ) ? s->stops + 1 : 0;
+	if ( (target == s->minPos) || (target == s->maxPos) )
+		return;
+	for ( uint8_t n=0; n<s->stops; ++n ) {
+		if ( s->stop[n] == target ) {
+			s->index = n + 1;
+			s->targetPos = target;
+			s->currentPos = target;
+			return;
+		}
+	}
+}
+#endif	// SERVO_POSITIONS
+//
+// ============================================================================
 // servoWiden -- Increase limit of current position of most recently toggled servo
 //
 // Do not go beyond the current minimum/maximum
@@ -173,10 +555,9 @@ void servoToggle( enum eServo idx )
 extern void servoWiden( void )
 {
 	uint16_t newPos;
-	uint16_t * addr;
 
 	if ( lastServo < SERVO_COUNT ) {
-		if ( servo[lastServo].targetPos == servo[lastServo].minPos ) {
+		if ( SERVO_AT_MIN( &servo[lastServo] ) ) {
 			newPos = servo[lastServo].minPos - SERVO_LIMIT_DELTA;
 			// Clip newpos to the absolute minimum limit
 			if ( newPos < SERVO_ABSOLUTE_MIN ) {
@@ -185,21 +566,28 @@ extern void servoWiden( void )
 
 			// !Never! cross the streams
 			if ( newPos < servo[lastServo].maxPos ) {
-				servoUpdateTargetPos( lastServo, newPos );
-				servoUpdateMinPos( lastServo, newPos );
+				servo[lastServo].targetPos = newPos;
+				servo[lastServo].minPos = newPos;
+				romMarkDirty();		// Committed after the last press
 			}
 		}
-		else if ( servo[lastServo].targetPos == servo[lastServo].maxPos ) {
+		else if ( SERVO_AT_MAX( &servo[lastServo] ) ) {
 			newPos = servo[lastServo].maxPos + SERVO_LIMIT_DELTA;
 			// Clip newpos to the absolute maximum limit
 			if ( newPos > SERVO_ABSOLUTE_MAX ) {
 				newPos = SERVO_ABSOLUTE_MAX;
 			}
 			if ( newPos > servo[lastServo].minPos ) {
-				servoUpdateTargetPos( lastServo, newPos );
-				servoUpdateMaxPos( lastServo, newPos );
+				servo[lastServo].targetPos = newPos;
+				servo[lastServo].maxPos = newPos;
+				romMarkDirty();		// Committed after the last press
 			}
 		}
+#ifdef SERVO_POSITIONS
+		else {
+			servoSetPosition( lastServo, servo[lastServo].targetPos + SERVO_LIMIT_DELTA );	// A stop, up
+		}
+#endif
 	}
 }
 //
@@ -213,7 +601,7 @@ extern void servoNarrow( void )
 	uint16_t newPos;
 
 	if ( lastServo < SERVO_COUNT ) {
-		if ( servo[lastServo].targetPos == servo[lastServo].minPos ) {
+		if ( SERVO_AT_MIN( &servo[lastServo] ) ) {
 			newPos = servo[lastServo].minPos + SERVO_LIMIT_DELTA;
 			// Clip newpos to the absolute maximum limit
 			if ( newPos > SERVO_ABSOLUTE_MAX ) {
@@ -222,11 +610,12 @@ extern void servoNarrow( void )
 
 			// !Never! cross the streams
 			if ( newPos < servo[lastServo].maxPos ) {
-				servoUpdateMinPos( lastServo, newPos );
-				servoUpdateTargetPos( lastServo, newPos );
+				servo[lastServo].minPos = newPos;
+				servo[lastServo].targetPos = newPos;
+				romMarkDirty();		// Committed after the last press
 			}
 		}
-		else if ( servo[lastServo].targetPos == servo[lastServo].maxPos ) {
+		else if ( SERVO_AT_MAX( &servo[lastServo] ) ) {
 			newPos = servo[lastServo].maxPos - SERVO_LIMIT_DELTA;
 			// Clip newpos to the absolute minimum limit
 			if ( newPos < SERVO_ABSOLUTE_MIN ) {
@@ -234,10 +623,16 @@ extern void servoNarrow( void )
 			}
 
 			if ( newPos > servo[lastServo].minPos ) {
-				servoUpdateMaxPos( lastServo, newPos );
-				servoUpdateTargetPos( lastServo, newPos );
+				servo[lastServo].maxPos = newPos;
+				servo[lastServo].targetPos = newPos;
+				romMarkDirty();		// Committed after the last press
 			}
 		}
+#ifdef SERVO_POSITIONS
+		else {
+			servoSetPosition( lastServo, servo[lastServo].targetPos - SERVO_LIMIT_DELTA );	// A stop, down
+		}
+#endif
 	}
 }
 //
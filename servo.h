@@ -20,31 +20,124 @@
 #define SERVO_PORT			PORTB
 #define SERVO_DDR			DDRB
 
-#define SERVO_COUNT			2
 #define SERVO1_PIN			3
 #define SERVO2_PIN			4
 //
+// servoData_t.Pin, ePorts_t in the high byte and the bit mask in the low byte
+#define SERVO_PIN(port,bit)		(((uint16_t)(port)<<8) | (1<<(bit)))
+#define SERVO_PIN_PORT(pin)		((pin)>>8)
+#define SERVO_PIN_MASK(pin)		((uint8_t)(pin))
+//
+// Build with -DSERVO_MUX to drive up to 8 servos from timer1 interrupts on plain
+// GPIO pins (see servomux.c), the hardware OC1A/OC1B outputs only drive two.
+// Servos 3-8 take the ISP pins, the debug LEDs and XTAL1, so with SERVO_MUX the
+// debug LEDs aren't fitted (see led.c) and the part must run from the internal
+// oscillator.
+// Each servo costs 34 bytes of SRAM plus 5 bytes in each schedule buffer, 8 servos
+// and the 64 byte ROM write queue use more than the 256 bytes of an ATtiny4313,
+// set SERVO_COUNT to what the board needs.
+#ifdef SERVO_MUX
+#ifndef SERVO_COUNT
+#define SERVO_COUNT			8
+#endif
+#define SERVO3_PIN			SERVO_PIN( ePORTB, PB5 )
+#define SERVO4_PIN			SERVO_PIN( ePORTB, PB6 )
+#define SERVO5_PIN			SERVO_PIN( ePORTB, PB7 )
+#define SERVO6_PIN			SERVO_PIN( ePORTB, PB2 )	// LED1
+#define SERVO7_PIN			SERVO_PIN( ePORTD, PD4 )	// LED2
+#define SERVO8_PIN			SERVO_PIN( ePORTA, PA0 )	// XTAL1
+#else
+#define SERVO_COUNT			2
+#endif
+#if SERVO_COUNT < 2 || SERVO_COUNT > 8
+#error "SERVO_COUNT must be 2 to 8"
+#endif
+//
+// Servo positions, limits and speeds are kept in units of 1/8us whatever the timer1
+// resolution (see SERVO_HIRES in servoturnout.h), so they mean the same thing in
+// both builds and in the ROM. SERVO_PWM() converts a position to timer1 counts.
+#define SERVO_UNITS_PER_US		8
+#define SERVO_US(us)			((us)*SERVO_UNITS_PER_US)
+#ifdef SERVO_HIRES
+#define SERVO_PWM(pos)			(pos)
+#else
+#define SERVO_PWM(pos)			((pos)>>3)
+#endif
+//
 // To prevent slamming the servo from it's old position to the new position the current
-// position is incremented on each heartbeat interrupt by SERVO_DELTA until it reaches
-// the new position.
-#define SERVO_DELTA			8
+// position is moved on each heartbeat interrupt according to the servo's motion profile
+// until it reaches the new position. SERVO_DELTA is the cruise speed per tic of a
+// servo whose speed hasn't been set, each servo's speed, acceleration, profile and
+// throw time can be changed from the console and are kept in the EEPROM (see rom.h).
+#define SERVO_DELTA			SERVO_US(8)
+//
+// Build with -DSERVO_ISR_STEP to step the servos in the timer1 interrupt at the
+// start of each PWM frame (servoFrame()) instead of in servoMove(), so a slow
+// pass of the main loop doesn't hold up or bunch the steps of a throw. The main
+// loop only plans moves, see servoMove(). Costs 12 bytes of SRAM per servo.
+// Not with SERVO_MUX.
+//
+// Build with -DSERVO_POSITIONS=n, 3 to 8, for three-way turnouts, crossing gates,
+// semaphores and the like: each servo then has a table of up to n positions,
+// minPos, up to n-2 stops and maxPos, and index says which entry targetPos is.
+// The stops in use, servoData_t.stops, start at 0, so a servo behaves as a two
+// position one until its table is set from the console. A toggle (button,
+// console 't') steps forward through the table, wrapping round, the console can
+// step back or select an entry directly, and DCC and TWI still select minPos or
+// maxPos. BTNPLUS/BTNMINUS on a stop move it up or down by SERVO_LIMIT_DELTA.
+// The table and its length are EEPROM board settings (see rom.h), the journal
+// keeps targetPos, which finds the entry again at boot. Every table access is
+// indexed, costs the same whatever n. Costs 2n-2 bytes of SRAM per servo, and
+// 4n-6 bytes of EEPROM, which with SERVO_MUX leaves room for few stops.
+#ifdef SERVO_POSITIONS
+#if SERVO_POSITIONS < 3 || SERVO_POSITIONS > 8
+#error "SERVO_POSITIONS must be 3 to 8"
+#endif
+#endif
 //
 // The servo open and closed positions are adjustable by pressing BTNPLUS and BTNMINUS.
 // SERVO_LIMIT_DELTA defines how much minPos/maxPos is changed each time the button is
 // pressed.
-#define SERVO_LIMIT_DELTA		10
+#define SERVO_LIMIT_DELTA		SERVO_US(10)
+//
+// Once a servo has held targetPos for SERVO_SETTLE_TICS tics its output is released,
+// so it stops hunting and buzzing against the stock rail. The next move re-arms it.
+// Build with -DSERVO_SETTLE_TICS=0 to keep the outputs running all the time.
+#ifndef SERVO_SETTLE_TICS
+#define SERVO_SETTLE_TICS		SERVO_HZ	// 1s
+#endif
 //
 // The 'new out of the box' values for the opened and closed positions
-#define SERVO_DEFAULT_MIN		1200
-#define SERVO_DEFAULT_CENTER	1500
-#define SERVO_DEFAULT_MAX		1800
+#define SERVO_DEFAULT_MIN		SERVO_US(1200)
+#define SERVO_DEFAULT_CENTER	SERVO_US(1500)
+#define SERVO_DEFAULT_MAX		SERVO_US(1800)
 //
 // The absolute limits that the servo can't be allowed to exceed
-#define SERVO_ABSOLUTE_MIN		1000
-#define SERVO_ABSOLUTE_MAX		2000
+#define SERVO_ABSOLUTE_MIN		SERVO_US(1000)
+#define SERVO_ABSOLUTE_MAX		SERVO_US(2000)
 //
 enum eServo { servo1, servo2 };
 //
+// Motion profiles, see motion.c
+enum eProfile { profileLinear, profileTrapezoid, profileSCurve };
+//
+// ============================================================================
+// Motion state for one servo. Velocities are Q8.8 position units per tic,
+// accelerations Q8.8 position units per tic per tic.
+typedef struct {
+	uint8_t		profile;			// enum eProfile
+	uint16_t	vMax;				// Cruise velocity
+	uint16_t	accel;				// Acceleration and deceleration (trapezoid)
+	uint16_t	goal;				// targetPos the current move is heading for
+	uint16_t	start;				// currentPos when the current move started
+	uint16_t	velocity;			// Current velocity (linear, trapezoid)
+	uint16_t	ramp;				// Distance needed to brake from velocity (trapezoid)
+	uint32_t	phase;				// Fraction of the move completed, /2^32 (S-curve, timed)
+	uint32_t	phaseStep;			// phase increment per tic (S-curve, timed)
+	uint16_t	throwTics;			// Tics for a full throw, 0 to move at vMax (see motion.h)
+	uint8_t		frac;				// Fractional part of currentPos
+} motion_t;
+//
 // ============================================================================
 // EEPROM data structure to preserve servo states between sessions
 typedef struct {
@@ -53,17 +146,44 @@ typedef struct {
 	uint16_t	maxPos;			// Servo's value for 'max' position
 	uint16_t	currentPos;			// Current position for this servo
 	uint16_t	Pin;				// This servo's Output pin
+	motion_t	motion;				// How currentPos gets to targetPos
+	uint8_t		settle;				// Tics held at targetPos, released at SERVO_SETTLE_TICS
+#ifdef SERVO_POSITIONS
+	uint8_t		stops;				// Entries of stop[] in use
+	uint8_t		index;				// Table entry targetPos is: 0 minPos, 1..stops stop[], stops+1 maxPos
+	uint16_t	stop[SERVO_POSITIONS-2];	// Positions between minPos and maxPos in the table
+#endif
 } servoData_t;
 //
 extern servoData_t servo[SERVO_COUNT];
+extern volatile uint8_t servoOutputs;	// COM1x1 bits of the attached OC1A/OC1B outputs
+extern uint16_t servoAttachCount;		// Outputs re-armed for a move
+extern uint16_t servoDetachCount;		// Outputs released after settling
+#ifdef SERVO_ISR_STEP
+extern volatile uint8_t servoFrames;	// Frames stepped by servoFrame(), modulo 256
+#endif
 //
 //extern const uint8_t jervoPins[];
 //
 //void configServoTimer(void);
 void servoMove( void );
+#ifdef SERVO_ISR_STEP
+void servoFrameInit( void );			// Start the frame ISR at currentPos
+void servoFrame( void );				// From the timer1 frame ISR, step every servo
+#endif
 void servoToggle( enum eServo idx );
+uint8_t servoSelect( enum eServo idx, uint8_t toMax );
+uint8_t servoSetLimit( enum eServo idx, uint16_t pos, uint8_t isMax );
+uint8_t servoSetMotion( enum eServo idx, const motion_t * m );	// Set and save speed, accel, profile, throw time
 void servoWiden( void );
 void servoNarrow( void );
+#ifdef SERVO_POSITIONS
+uint8_t servoGoTo( enum eServo idx, uint8_t index );	// Select a table entry, 0 if there is none
+void servoStep( enum eServo idx, uint8_t back );	// Next table entry, or the previous one
+uint8_t servoSetStops( enum eServo idx, uint8_t stops );	// Stops in use, 0 if too many or EEPROM full
+uint8_t servoSetPosition( enum eServo idx, uint16_t pos );	// Move the current table entry
+void servoIndexFind( enum eServo idx, uint16_t target );	// Find the entry a saved target is
+#endif
 //
 // ============================================================================
 //
@@ -0,0 +1,203 @@
+//
+// ============================================================================
+//
+// servomux.c -- Software multiplexed servo outputs for program servoturnout.c
+//
+// ============================================================================
+//
+#include <stdint.h>
+//
+#include "hal.h"
+#include "servoturnout.h"
+//
+#include "servo.h"
+#include "servomux.h"
+#include "timebase.h"
+//
+#ifdef SERVO_MUX
+//
+#ifdef SERVO_HIRES
+#error "SERVO_MUX and SERVO_HIRES both need the timer1 interrupts"
+#endif
+//
+// ============================================================================
+//
+static muxSchedule_t	muxSched[2];		// Double buffered pulse schedule
+static volatile uint8_t	muxActive;			// Schedule the ISRs are using
+static volatile uint8_t	muxSwap;			// Set when the other schedule is ready
+static uint8_t			muxNext;			// Next entry for the compare ISR
+volatile uint16_t		muxIsrMax;			// Worst compare ISR overrun, counts
+//
+// ============================================================================
+// muxPortIndex -- Map a servoData_t.Pin port to a mask index
+//
+static uint8_t muxPortIndex( uint16_t pin )
+{
+	switch ( SERVO_PIN_PORT( pin ) ) {
+		case ePORTA:
+			return muxPortA;
+		case ePORTB:
+			return muxPortB;
+		default:
+			return muxPortD;
+	}
+}
+//
+// ============================================================================
+// muxUpdate -- Rebuild the schedule from servo[].currentPos
+//
+// Insertion sort into the schedule the ISRs are not using, leaving out servos
+// whose output has been released (see servoSettle()). muxSwap is cleared
+// before looking at muxActive so the capture ISR can't switch to the buffer
+// while it is half written; it picks up the new one at the next frame.
+//
+void muxUpdate( void )
+{
+	muxSchedule_t *	s;
+	uint16_t		t;
+	uint8_t			idx, n, port, mask;
+
+	muxSwap = 0;
+	s = &muxSched[muxActive ^ 1];
+
+	s->count = 0;
+	for ( port=0; port<MUX_PORTS; ++port )
+		s->start[port] = 0;
+
+	for ( idx=0; idx<SERVO_COUNT; ++idx ) {
+		if ( SERVO_SETTLE_TICS && (servo[idx].settle >= SERVO_SETTLE_TICS) )
+			continue;
+		t = SERVO_PWM( servo[idx].currentPos );
+		port = muxPortIndex( servo[idx].Pin );
+		mask = SERVO_PIN_MASK( servo[idx].Pin );
+		s->start[port] |= mask;
+
+		for ( n=s->count; (n > 0) && (s->event[n-1].time > t); --n )
+			;
+		if ( (n > 0) && (s->event[n-1].time == t) ) {
+			s->event[n-1].mask[port] |= mask;		// Same edge as an earlier servo
+			continue;
+		}
+		for ( uint8_t i=s->count; i>n; --i )
+			s->event[i] = s->event[i-1];
+		s->event[n].time = t;
+		s->event[n].mask[muxPortA] = 0;
+		s->event[n].mask[muxPortB] = 0;
+		s->event[n].mask[muxPortD] = 0;
+		s->event[n].mask[port] = mask;
+		++s->count;
+	}
+
+	muxSwap = 1;
+}
+//
+// ============================================================================
+// muxInit -- Configure the servo pins and timer1, start the frames
+//
+// WGM13:0 mode 12 (CTC, TOP in ICR1). Unlike the PWM modes OCR1A isn't double
+// buffered, so the compare ISR can move it on to the next edge. ICF1 is set at
+// TOP, the capture interrupt marks the start of each frame. OC1A/OC1B stay
+// disconnected, every servo pin is plain GPIO.
+//
+void muxInit( void )
+{
+	for ( uint8_t idx=0; idx<SERVO_COUNT; ++idx ) {
+		uint8_t mask = SERVO_PIN_MASK( servo[idx].Pin );
+
+		switch ( muxPortIndex( servo[idx].Pin ) ) {
+			case muxPortA:
+				PORTA &= ~mask;
+				DDRA |= mask;
+				break;
+			case muxPortB:
+				PORTB &= ~mask;
+				DDRB |= mask;
+				break;
+			default:
+				PORTD &= ~mask;
+				DDRD |= mask;
+				break;
+		}
+	}
+
+	muxUpdate();
+
+	TIMSK &= ~((1<<TOIE1) | (1<<OCIE1A) | (1<<OCIE1B) | (1<<ICIE1));
+	TCNT1 = 0;
+	ICR1 = PWMTOP - 1;				// The period is ICR1+1 counts
+	TCCR1A = ((0<<WGM11) | (0<<WGM10));
+	TCCR1B = ((1<<WGM13) | (1<<WGM12) | (0<<CS12) | (1<<CS11) | (0<<CS10));
+	TCCR1C = 0;
+	TIFR = (1<<ICF1) | (1<<OCF1A);
+	TIMSK |= (1<<ICIE1);
+}
+//
+// ============================================================================
+// TIMER1_CAPT -- Start of frame, raise every servo pin
+//
+// With TB_TIMER1 this is the heartbeat too, the schedule muxUpdate() builds in
+// the tic is swapped in at the start of the next frame.
+//
+ISR(TIMER1_CAPT_vect)
+{
+	const muxSchedule_t * s;
+
+	if ( muxSwap ) {
+		muxActive ^= 1;
+		muxSwap = 0;
+	}
+	s = &muxSched[muxActive];
+
+	PORTA |= s->start[muxPortA];
+	PORTB |= s->start[muxPortB];
+	PORTD |= s->start[muxPortD];
+
+	muxNext = 0;
+	if ( s->count ) {
+		OCR1A = s->event[0].time;
+		TIFR = (1<<OCF1A);
+		TIMSK |= (1<<OCIE1A);
+	}
+#ifdef TB_TIMER1
+	tbTimer1Period( 1 );
+#endif
+}
+//
+// ============================================================================
+// TIMER1_COMPA -- End the pulses due now and any that follow too closely
+//
+ISR(TIMER1_COMPA_vect)
+{
+	const muxSchedule_t * s = &muxSched[muxActive];
+	const muxEvent_t * e;
+	uint16_t	due = OCR1A;
+	uint16_t	late;
+	uint8_t		n = muxNext;
+
+	for ( ;; ) {
+		e = &s->event[n];
+		PORTA &= ~e->mask[muxPortA];
+		PORTB &= ~e->mask[muxPortB];
+		PORTD &= ~e->mask[muxPortD];
+
+		if ( ++n >= s->count ) {
+			TIMSK &= ~(1<<OCIE1A);
+			break;
+		}
+		if ( (int16_t)(s->event[n].time - TCNT1) > MUX_MIN_GAP ) {
+			OCR1A = s->event[n].time;
+			break;
+		}
+		halTimer1Wait( s->event[n].time );
+	}
+	muxNext = n;
+
+	late = TCNT1 - due;
+	if ( late > muxIsrMax )
+		muxIsrMax = late;
+}
+//
+#endif	// SERVO_MUX
+//
+// ============================================================================
+//
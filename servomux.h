@@ -0,0 +1,48 @@
+#ifndef _SERVOMUX_H_
+#define _SERVOMUX_H_
+//
+// ============================================================================
+//
+// servomux.h -- Software multiplexed servo outputs, build with -DSERVO_MUX
+//
+// ============================================================================
+//
+// Timer1 runs in CTC mode 12 at clk/8 with TOP in ICR1, one period per 20ms
+// frame. The input capture interrupt at TOP raises every servo pin, the OCR1A
+// compare interrupt then walks a schedule of falling edges sorted by time.
+// Servos whose pulses end at the same count share one schedule entry.
+//
+// The schedule is rebuilt by muxUpdate() only when a position has changed,
+// into the buffer the ISRs are not using, and handed over at the next frame.
+//
+// Edges closer together than MUX_MIN_GAP counts are too close to take another
+// interrupt, the compare ISR busy-waits for them instead. The ISR therefore
+// costs at most SERVO_COUNT-1 gaps plus one clear per entry, muxIsrMax records
+// the worst case seen.
+//
+// Needs servo.h
+//
+#define MUX_MIN_GAP			10		// Timer1 counts (us), ISR entry and exit with margin
+//
+// Ports a servo pin can be on, index into the mask arrays
+enum eMuxPort { muxPortA, muxPortB, muxPortD, MUX_PORTS };
+//
+typedef struct {
+	uint16_t	time;				// Timer1 count at which the pulses end
+	uint8_t		mask[MUX_PORTS];	// Pins to clear
+} muxEvent_t;
+//
+typedef struct {
+	uint8_t		count;				// Entries in event[]
+	uint8_t		start[MUX_PORTS];	// Pins to raise at the start of the frame
+	muxEvent_t	event[SERVO_COUNT];	// Falling edges, sorted by time
+} muxSchedule_t;
+//
+extern volatile uint16_t muxIsrMax;	// Worst compare ISR exit time past its first edge, counts
+//
+void muxInit( void );				// Configure the servo pins and timer1, start the frames
+void muxUpdate( void );				// Rebuild the schedule from servo[].currentPos
+//
+// ============================================================================
+//
+#endif	// _SERVOMUX_H_
@@ -13,6 +13,7 @@
 // turn servos slowly to prevent wear and tear
 // Design an interface to allow adjustable servo limits
 //	 Idea 1: Design a command interface running on the UART
+//		Build with -DUART_CONSOLE, see console.h. Takes the BTN+ and BTN- pins.
 //
 //	 Idea 2: Design an interface based on LEDs and buttons
 //	 	Add two buttons, 'BTN+' and 'BTN-' to the PC board. When BTN+ is
@@ -38,13 +39,13 @@
 //	 SOIC Pin			Function			Usage
 //	 --------			--------			-----
 //		  1				~RESET				RESET
-//		  2				PD0					BTPLUS
-//		  3				PD1					BTMINUS
-//		  4				PA1, XTAL2			NA
-//		  5				PA0, XTAL1			NA
+//		  2				PD0					BTPLUS, RXD with UART_CONSOLE
+//		  3				PD1					BTMINUS, TXD with UART_CONSOLE
+//		  4				PA1, XTAL2			NA, DCC input with DCC_DECODER
+//		  5				PA0, XTAL1			NA, frog relay 2 with FROG_RELAY
 //		  6				PD2					BTS1
 //		  7				PD3					BTS2
-//		  8				PD4					LED2
+//		  8				PD4					LED2, frog relay 1 with FROG_RELAY
 //		  9				PD5					LD2A
 //		 10				GND					GND
 //		 11				PD6					LD2B
@@ -53,9 +54,9 @@
 //		 14				PB2					LED1
 //		 15				OC1A, PB3			SV1
 //		 16				OC1B, PB4			SV2
-//		 17				PB5,MOSI			MOSI
+//		 17				PB5,MOSI			MOSI, SDA with TWI_SLAVE
 //		 18				PB6,MISO			MISO
-//		 19				PB7,SCK				SCK
+//		 19				PB7,SCK				SCK, SCL with TWI_SLAVE
 //		 20				VCC					V5
 //
 // ============================================================================
@@ -64,6 +65,10 @@
 // Configure LEDs on PD4, PD5, PD6, PB0, PB1 and PB2 as outputs
 // Configure Buttons on PD0, PD1, PD2 and PD3 as inputs
 // Configure Servo drive signals on PB3 and PB4 as Timer 1 PWM
+//	 or with SERVO_MUX, up to 8 servo signals as GPIO, see servo.h
+// With DCC_DECODER, the DCC track signal on PA1, see dcc.h
+// With TWI_SLAVE, the I2C bus on PB5/PB7, see twi.h
+// With FROG_RELAY, the frog relay coil drivers on PD4 and PA0, see frog.h
 // ============================================================================
 //
 // ============================================================================
@@ -71,107 +76,180 @@
 // ============================================================================
 //
 #include <stdint.h>
-
-#include <avr/io.h>
-#include <avr/interrupt.h>
-//#include <avr/eeprom.h>
-#include <avr/pgmspace.h>
 //
+#include "hal.h"
 #include "servoturnout.h"
 #include "servo.h"
 #include "button.h"
 #include "led.h"
 #include "rom.h"
+#include "servomux.h"
+#include "timebase.h"
+#include "uart.h"
+#include "console.h"
+#include "telemetry.h"
+#include "dcc.h"
+#include "twi.h"
+#include "frog.h"
+#include "sched.h"
 // 
 // ============================================================================
-volatile uint8_t TicCnt = 0;
-
-uint8_t	eepromUpdateFlag = 0;		// Set when eeprom data is dirty
+#ifdef IDLE_STATS
+uint32_t idleTics;					// Heartbeats handled
+uint32_t idleActiveCounts;			// Timer1 counts spent awake
+uint16_t idleActiveMax;				// Longest time awake between sleeps
+static uint16_t idleWake;			// timer1 count when the loop last woke up
+#endif
 //
 // ======================================================================================
-// timer0_Init -- Initialize timer0 in CTC mode w/ interrupts enabled
+// timer1_Init -- Configure timer1 to generate 2 channel PWM
 //
-// Operate the timer in CTC mode, the timer repeatedly counts from zero to OCR0A,
-// and generates an TIMER0_COMPA interrupt at OCR0A. OCR0A and CS0x are selected
-// to generate an approx 100Hz heartbeat interrupt.
+// Notes:
+//	timer1 PWM channel 0 is on OC1A/PB3
+//	timer1 PWM channel 1 is on OC1B/PB4
+//	Use fast PWM WGM13:0 mode 14 (0b00001110) with the TOP value in ICR1
 //
-// CS02:CS01:CS00 determines clock source and divisor
-// 0b000: Clock off
-// 0b001: ClkIO/1
-// 0b010: ClkIO/8
-// 0b011: ClkIO/64
-// 0b100: ClkIO/256
-// 0b101: ClkIO/1024
+void timer1_Init( void )
+{
+#ifdef SERVO_ISR_STEP
+	servoFrameInit();				// The frame ISR starts from the loaded positions
+#endif
+	DDRB |= ((1<<PB3) | (1<<PB4));	// Set PWM pins for output
+TIMSK &= ~(0xE8);				// Disable all timer 1 interrupts
+	TCNT1 = 0;
+	ICR1 = PWMTOP - 1;				// The period is ICR1+1 counts
+	OCR1A = SERVO_PWM( SERVO_DEFAULT_CENTER );
+	OCR1B = SERVO_PWM( SERVO_DEFAULT_CENTER );
+	TCCR1A = ((1<<COM1A1) | (0<<COM1A0) | (1<<COM1B1) | (0<<COM1B0) | (1<<WGM11) | (0<<WGM10));
+#ifdef SERVO_HIRES
+	TIFR = (1<<OCF1A) | (1<<OCF1B) | (1<<TOV1);
+	TIMSK |= (1<<OCIE1A) | (1<<OCIE1B) | (1<<TOIE1);
+	TCCR1B = ((1<<WGM13) | (1<<WGM12) | (0<<CS12) | (0<<CS11) | (1<<CS10));
+#else
+#if defined( TB_TIMER1 ) || defined( SERVO_ISR_STEP )
+	TIFR = (1<<TOV1);
+	TIMSK |= (1<<TOIE1);			// The frame ISR, see below
+#endif
+	TCCR1B = ((1<<WGM13) | (1<<WGM12) | (0<<CS12) | (1<<CS11) | (0<<CS10));
+#endif
+	TCCR1C = 0;
+}
+#ifdef SERVO_HIRES
 //
-// Note: OCF0A is cleared by hardware when executing the interrupt handler
+// ======================================================================================
+// TIMER1_OVF/COMPA/COMPB -- ISRs gating the outputs to one PWM period per frame
 //
-void timer0_Init( void )
+// Each channel is disconnected by its compare match ISR in sub-frame 0, after its
+// pulse has ended, so the pin is left low. The attached ones (servoOutputs) are
+// reconnected at the start of the last sub-frame. The waveform generator doesn't touch OC1x while disconnected, so
+// OC1x is still low when reconnected and the next pulse starts cleanly at BOTTOM.
+// The frame's first sub-frame steps the servos with SERVO_ISR_STEP, and raises
+// the heartbeat tic with TB_TIMER1.
+//
+static volatile uint8_t subFrame = 0;	// PWM period within the 20ms frame
+
+ISR(TIMER1_OVF_vect)
+{
+	if ( ++subFrame >= SERVO_SUBFRAMES ) {
+		subFrame = 0;
+		TIFR = (1<<OCF1A) | (1<<OCF1B);			// Catch the end of this period's pulses
+		TIMSK |= (1<<OCIE1A) | (1<<OCIE1B);
+	}
+	else if ( (SERVO_SUBFRAMES-1) == subFrame ) {
+		TCCR1A |= servoOutputs;					// Released servos stay disconnected
+	}
+#ifdef SERVO_ISR_STEP
+	if ( 0 == subFrame )
+		servoFrame();
+#endif
+#ifdef TB_TIMER1
+	tbTimer1Period( 0 == subFrame );
+#endif
+}
+
+ISR(TIMER1_COMPA_vect)
 {
-	TIFR &= ~(OCF0A);					// Clear stale overflow interrupt
-	TCCR0A = ((1<<WGM01) | (0<<WGM00));	// CTC Mode
-	TCCR0B = ((0<<WGM02) | (1<<CS02) | (0<<CS01) | (1<<CS00));
-	TCNT0 = 0;
-	OCR0A = ((FCPU)/(1024L*SERVO_HZ));
-//	OCR0A = 156;
-	TIMSK |= (1<<OCIE0A);				// Interrupt when OCF0A is set
+	TCCR1A &= ~(1<<COM1A1);
+	TIMSK &= ~(1<<OCIE1A);
 }
+
+ISR(TIMER1_COMPB_vect)
+{
+	TCCR1A &= ~(1<<COM1B1);
+	TIMSK &= ~(1<<OCIE1B);
+}
+#elif !defined(SERVO_MUX)
+#if defined( TB_TIMER1 ) || defined( SERVO_ISR_STEP )
 //
 // ======================================================================================
-// TIMER0_COMPA -- ISR for timer 0 compare match event
+// TIMER1_OVF -- ISR at TOP, the start of each frame
 //
-// This is the heartbeat ISR. Increment TicCnt and let the non-ISR code deal with
-// everything.
+// Steps the servos with SERVO_ISR_STEP, and is the heartbeat with TB_TIMER1
+// (see timebase.h). OCR1A/OCR1B are double buffered and latched at BOTTOM, so
+// positions written in this frame, here or by the main loop, are sent in the
+// next one.
 //
-ISR(TIMER0_COMPA_vect)
+ISR(TIMER1_OVF_vect)
 {
-	++TicCnt;
+#ifdef SERVO_ISR_STEP
+	servoFrame();
+#endif
+#ifdef TB_TIMER1
+	tbTimer1Period( 1 );
+#endif
 }
+#endif	// TB_TIMER1 || SERVO_ISR_STEP
 //
 // ======================================================================================
-// timer1_Init -- Configure timer1 to generate 2 channel PWM, no interrupts
+// TIMER1_COMPA/COMPB -- ISRs releasing an idle servo's output after its pulse
 //
-// Notes:
-//	timer1 PWM channel 0 is on OC1A/PB3
-//	timer1 PWM channel 1 is on OC1B/PB4
-//	Use fast PWM WGM13:0 mode 14 (0b00001110) with the TOP value in ICR1
+// Enabled by servoOutput() when a servo has settled. Unless the servo has been
+// re-armed in the meantime the pin is disconnected right after the compare match,
+// with OC1x low, so the last pulse isn't cut short.
 //
-void timer1_Init( void )
+ISR(TIMER1_COMPA_vect)
 {
-	DDRB |= ((1<<PB3) | (1<<PB4));	// Set PWM pins for output
-TIMSK &= ~(0xE8);				// Disable all timer 1 interrupts
-	TCNT1 = 0;
-	ICR1 = PWMTOP;
-	OCR1A = SERVO_DEFAULT_CENTER;
-	OCR1B = SERVO_DEFAULT_CENTER;
-	TCCR1A = ((1<<COM1A1) | (0<<COM1A0) | (1<<COM1B1) | (0<<COM1B0) | (1<<WGM11) | (0<<WGM10));
-	TCCR1B = ((1<<WGM13) | (1<<WGM12) | (0<<CS12) | (1<<CS11) | (0<<CS10));
-	TCCR1C = 0;
+	if ( !(servoOutputs & (1<<COM1A1)) )
+		TCCR1A &= ~(1<<COM1A1);
+	TIMSK &= ~(1<<OCIE1A);
 }
+
+ISR(TIMER1_COMPB_vect)
+{
+	if ( !(servoOutputs & (1<<COM1B1)) )
+		TCCR1A &= ~(1<<COM1B1);
+	TIMSK &= ~(1<<OCIE1B);
+}
+#endif	// SERVO_HIRES
 //
 // ============================================================================
-// checkButtons -- check state of buttons, process any changes
+// checkButtons -- Process the queued button events
+//
+// BTS1/BTS2 are toggle switches, either edge throws the turnout. BTN+ and BTN-
+// act when pressed.
 //
 static void checkButtons( void )
 {
-	for ( enum eButton idx=0; idx<(enum eButton)BUTTON_COUNT; ++idx ) {
-		if (btnChanged( idx ) ) {
-			switch( idx ) {
-				case btnPlus:
+	uint8_t event;
+
+	while ( BTN_EVENT_NONE != (event = btnEvent()) ) {
+		switch( event & BTN_EVENT_ID ) {
+			case btnPlus:
+				if ( event & BTN_EVENT_PRESS )
 					servoWiden();
-					break;
-				case btnMinus:
+				break;
+			case btnMinus:
+				if ( event & BTN_EVENT_PRESS )
 					servoNarrow();
-					break;
-				case btnServo1:
-					servoToggle( servo1 );
-					break;
-				case btnServo2:
-					servoToggle( servo2 );
-					break;
-			}
+				break;
+			case btnServo1:
+				servoToggle( servo1 );
+				break;
+			case btnServo2:
+				servoToggle( servo2 );
+				break;
 		}
 	}
-
 }
 #ifdef LED_DEBUG
 //
@@ -262,92 +340,152 @@ void btntest( void )
 
 #endif	// BTN_TEST
 
+#ifdef IDLE_STATS
 //
 // ============================================================================
-// delayTic -- Delay one timer tic
+// idleAwake -- Add the time since the loop woke up to the active count
+//
+// Timer1 wraps every PWM period, which is longer than any one pass of the loop.
 //
-void delayTic( void )
+static void idleAwake( void )
 {
-	uint8_t OldTic;
+	uint16_t	now = halTimer1Count();
+	uint16_t	active;
 
-	OldTic = TicCnt;
-	while ( OldTic == TicCnt )
-		;
+	active = ( now >= idleWake ) ? now - idleWake : now + (ICR1 + 1) - idleWake;
+	idleActiveCounts += active;
+	if ( active > idleActiveMax )
+		idleActiveMax = active;
 }
+#endif	// IDLE_STATS
 //
 // ============================================================================
-// delayCenti -- Wait for a number of 10ms intervals
+// buttonTask -- Confirm settled button changes and act on them
 //
-void delayCenti( int centisecs )
+static void buttonTask( void )
 {
-	volatile int count;
-
-	while ( centisecs>0 ) {
-		for ( count=0; count<5000; ++count ) {
-		}
-		--centisecs;
-	}
+	btnHeartBeat();				// Confirm button changes that have settled
+	checkButtons();				// Toggle or adjust the servos
 }
 //
 // ============================================================================
-// selfTest -- Do a self test sequence
+// ledTask -- Show this tic's LED changes
+//
+// For the first SELFTEST_TICS tics after reset all the LEDs flash on and off
+// over whatever the servos have set, one tic each, as a self test. Afterwards
+// servoMove() sets them again every tic.
 //
-void selfTest( void )
+#define SELFTEST_TICS	6		// Three flashes
+
+static uint8_t selfTestTics = SELFTEST_TICS;
+
+static void ledTask( void )
 {
-	uint8_t iLED;
-//	for ( uint8_t idx=0; idx<3; ++idx ) {
-	while ( 1 ) {
-		//for ( iLED=0; iLED<=LED_COUNT; ++iLED ) {
-			ledOn( LD1A );
-			ledOn( LD1B );
-			ledOn( LD2A );
-			ledOn( LD2B );
-			ledOn( LED1 );
-			delayTic();
-			ledOff( LD1A );
-			ledOff( LD1B );
-			ledOff( LD2A );
-			ledOff( LD2B );
-			ledOff( LED1 );
-			delayTic();
-		//}
+	if ( selfTestTics ) {
+		--selfTestTics;
+		for ( enum eLED idx=LD1A; idx<=LED1; ++idx )
+			ledSet( idx, selfTestTics & 1 );
 	}
+	else {
+		ledPattern( LED1, (eepromUpdateFlag & ROM_FLAG_ERROR) ? ledEepromError : ledSteady );
+	}
+	ledApply();
 }
 //
 // ============================================================================
+// schedTasks -- The main loop, see sched.h
+//
+// The polled inputs first, so a command received before a tic acts on it, and
+// the buttons, so a throw starts on the tic it is confirmed. Then the servos,
+// so when they are updated doesn't depend on what else is built in, and the
+// work that follows from their new positions.
+//
+const schedTask_t schedTasks[] PROGMEM = {
+#ifdef UART_CONSOLE
+	{ consolePoll,		0, 0 },		// Run commands received since the last pass
+#endif
+#ifdef DCC_DECODER
+	{ dccPoll,			0, 0 },		// Act on a DCC packet received since the last pass
+#endif
+#ifdef TWI_SLAVE
+	{ twiPoll,			0, 0 },		// Apply register writes received since the last pass
+#endif
+	{ buttonTask,		1, 0 },		// Throw or adjust on settled button changes
+	{ servoMove,		1, 0 },		// Step the servos along their motion profiles
+#ifdef FROG_RELAY
+	{ frogHeartBeat,	1, 0 },		// Change frog polarity as the points pass the switch point
+#endif
+	{ ledTask,			1, 0 },		// Show this tic's LED changes
+#ifdef UART_TELEMETRY
+	{ telemHeartBeat,	1, 0 },		// Stream this tic's changes
+#endif
+#ifdef TWI_SLAVE
+	{ twiHeartBeat,		2, 1 },		// Refresh the registers the bus master reads, twiPoll() does after a write
+#endif
+	{ romHeartBeat,		1, 0 },		// Commit calibration changes once the buttons go quiet
+	{ NULL,				0, 0 },
+};
+_Static_assert( sizeof(schedTasks)/sizeof(schedTasks[0]) <= SCHED_TASK_MAX+1, "raise SCHED_TASK_MAX" );
+//
+// ============================================================================
 //
 int main(void)
 {
+	uint8_t		tic;
 
 	// Setup ==================================================================
 	romServoDataInitialize();	// Initialize servo data from persistent storage
-	timer0_Init();				// Configure timer0 to generate a heartbeat interrupt
+	tbInit();					// Configure timer0 to generate a heartbeat interrupt, or just the LED timing with TB_TIMER1
+#ifdef SERVO_MUX
+	muxInit();					// Configure timer1 to multiplex the servo signals
+#else
 	timer1_Init();				// Configure timer1 to generate PWM for the servo signal
+#endif
 	btnConfig();				// Configure button interface
 	ledConfig();				// Configure LED interface
-
-	selfTest();					// Do a self test sequence
+#ifdef FROG_RELAY
+	frogInit();					// Set the frog relays to match the servos
+#endif
+#ifdef UART_CONSOLE
+	uartInit();					// Configure the USART for the command interface
+#endif
+#ifdef DCC_DECODER
+	dccInit();					// Configure the DCC input, needs timer1 running
+#endif
+#ifdef TWI_SLAVE
+	twiInit();					// Configure the USI as an I2C slave
+#endif
+	schedInit();				// Spread the periodic tasks over their phases
 
 	sei();
 
 	// Loop ===================================================================
-	while( 1 ) {
-		if ( TicCnt ) {
-			--TicCnt;
-			btnHeartBeat();		// Do periodic service for the buttons
-
-			// Debug steps
-			// - verify servos
-			// - verify eeprom functionality
-			// - integrate subsystems
-			
-			// Check to see if a button has been pressed
-			checkButtons();
+#ifdef IDLE_STATS
+	idleWake = halTimer1Count();
+#endif
+	while( halRunning() ) {
+		tic = tbTake();
+#ifdef IDLE_STATS
+		idleTics += tic;
+#endif
+		schedRun( tic );		// The polled tasks, and on a tic the periodic ones due
 
-			// Adjust servo positions
-			servoMove();
+		if ( !tic ) {
+#ifdef IDLE_STATS
+			idleAwake();
+#endif
+#ifdef UART_CONSOLE
+			halIdle( tbReady() || uartRxCount() );	// Sleep until the next heartbeat or byte
+#else
+			halIdle( tbReady() );	// Sleep until the next heartbeat
+#endif
+#ifdef IDLE_STATS
+			idleWake = halTimer1Count();
+#endif
 		}
 	}
+
+	return 0;
 }
 //
 // ============================================================================
@@ -4,12 +4,32 @@
 //
 #define FCPU				8000000UL	// Default internal oscillator is 8MHz
 #define SERVO_HZ			50L
+//
+// Timer1 normally runs at clk/8, 1us per count, one PWM period per 20ms frame.
+// Build with -DSERVO_HIRES for clk/1, 0.125us per count. A 20ms frame doesn't
+// fit in 16 bits at clk/1, so the frame is split into SERVO_SUBFRAMES PWM
+// periods and the outputs are only connected for the first of them.
+#ifdef SERVO_HIRES
+#define TIMER1_DIVISOR		1L
+#define SERVO_SUBFRAMES		4
+#else
 #define TIMER1_DIVISOR		8L
-#define PWMTOP				(FCPU/((TIMER1_DIVISOR)*(SERVO_HZ)))
+#define SERVO_SUBFRAMES		1
+#endif
+#define PWMTOP				(FCPU/((TIMER1_DIVISOR)*(SERVO_HZ)*(SERVO_SUBFRAMES)))
 
-typedef enum { ePORTUnknown, ePORTB, ePORTC, ePORTD } ePorts_t;
+typedef enum { ePORTUnknown, ePORTB, ePORTC, ePORTD, ePORTA } ePorts_t;
 //
 extern const char mydata[] PROGMEM;
-extern uint8_t eepromUpdateFlag;
+extern volatile uint8_t eepromUpdateFlag;	// ROM_FLAG_xxx, see rom.h
+//
+// Build with -DIDLE_STATS to measure how long the main loop is awake between
+// sleeps, in timer1 counts (TIMER1_DIVISOR cycles each). Time spent in ISRs
+// while asleep isn't included.
+#ifdef IDLE_STATS
+extern uint32_t idleTics;			// Heartbeats handled
+extern uint32_t idleActiveCounts;	// Timer1 counts spent awake
+extern uint16_t idleActiveMax;		// Longest time awake between sleeps
+#endif
 //
 #endif	// _SERVOTURNOUT_H_
@@ -0,0 +1,138 @@
+//
+// ============================================================================
+//
+// telemdecode.c -- Host (Linux) decoder for the servoturnout telemetry stream
+//
+// ============================================================================
+//
+// Reads the UART byte stream on stdin, skips console text and anything that
+// doesn't check out, and prints each frame's state as a line of text:
+//
+//	seq K|D  servo1 current/target ...  buttons
+//
+// Positions are in us. Deltas arriving after a lost frame are not applied
+// until the next key frame. Totals are printed at the end of the input.
+//
+// Usage: servoturnout-host -u script | telemdecode [-q]
+//	-q			Only print the totals
+//
+// ============================================================================
+//
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+//
+#define SERVO_HZ			50L		// For TELEM_KEY_TICS, unused here
+#include "telemetry.h"
+//
+#define DECODE_SERVOS		8		// Most servos a key frame may carry
+#define DECODE_UNITS_PER_US	8.0		// SERVO_UNITS_PER_US
+//
+static uint16_t	state[TELEM_FIELDS( DECODE_SERVOS )];
+static uint8_t	servos;				// From the last key frame, 0 until one arrives
+static int		synced;				// Sequence unbroken since the last key frame
+static uint8_t	nextSeq;
+static unsigned long frames, keys, deltas, lost, errors, frameBytes;
+//
+// ============================================================================
+// decodeFrame -- Apply one frame with a good crc, return 0 if it is malformed
+//
+// f is the header and payload, len bytes.
+//
+static int decodeFrame( const uint8_t * f, uint8_t len )
+{
+	const uint8_t *	end = f + len;
+	const uint8_t *	mask;
+	uint8_t			field, count;
+	int8_t			diff;
+
+	if ( frames && ((f[0] & TELEM_SEQ) != nextSeq) ) {
+		lost += ( f[0] - nextSeq ) & TELEM_SEQ;
+		synced = 0;
+	}
+	nextSeq = ( f[0] + 1 ) & TELEM_SEQ;
+
+	if ( f[0] & TELEM_KEY ) {
+		count = f[1];
+		if ( (count > DECODE_SERVOS) || (len != 2 + 4*count + 1) )
+			return 0;
+		f += 2;
+		for ( field=0; field<2*count; ++field, f+=2 )
+			state[field] = f[0] | (f[1] << 8);
+		state[field] = *f;
+		servos = count;
+		synced = 1;
+		++keys;
+		return 1;
+	}
+
+	++deltas;
+	if ( !synced || !servos )
+		return 1;					// Nothing to apply the deltas to
+	mask = f + 1;
+	f = mask + TELEM_MASK_BYTES( servos );
+	for ( field=0; field<TELEM_FIELDS( servos ); ++field ) {
+		if ( !(mask[field>>3] & (1<<(field & 7))) )
+			continue;
+		if ( f >= end )
+			return 0;
+		if ( field == 2*servos ) {
+			state[field] = *f++;
+			continue;
+		}
+		diff = (int8_t)*f++;
+		if ( TELEM_ESCAPE == diff ) {
+			if ( f + 2 > end )
+				return 0;
+			state[field] = f[0] | (f[1] << 8);
+			f += 2;
+		}
+		else {
+			state[field] += diff;
+		}
+	}
+	return f == end;
+}
+//
+// ============================================================================
+//
+int main( int argc, char ** argv )
+{
+	uint8_t	frame[256];
+	int		quiet = ( argc > 1 ) && !strcmp( argv[1], "-q" );
+	int		c;
+	uint8_t	len, n, crc, key;
+
+	while ( (c = getchar()) != EOF ) {
+		if ( TELEM_SYNC != c )
+			continue;
+		if ( (c = getchar()) == EOF )
+			break;
+		len = c;
+		crc = telemCrc( 0, len );
+		for ( n=0; n<len && (c = getchar()) != EOF; ++n ) {
+			frame[n] = c;
+			crc = telemCrc( crc, c );
+		}
+		if ( (n < len) || (c = getchar()) == EOF )
+			break;
+		if ( (0 == len) || (crc != c) || !decodeFrame( frame, len ) ) {
+			++errors;				// Resynchronise at the next TELEM_SYNC
+			continue;
+		}
+		++frames;
+		frameBytes += len + 3;
+		key = ( frame[0] & TELEM_KEY ) != 0;
+		if ( quiet || !synced )
+			continue;
+
+		printf( "%3u %c", frame[0] & TELEM_SEQ, key ? 'K' : 'D' );
+		for ( n=0; n<servos; ++n )
+			printf( "  %7.3f/%7.3f", state[2*n] / DECODE_UNITS_PER_US, state[2*n+1] / DECODE_UNITS_PER_US );
+		printf( "  buttons 0x%02x\n", state[2*servos] );
+	}
+
+	printf( "%lu frames, %lu key, %lu delta, %lu lost, %lu bad, %.1f bytes/frame\n",
+			frames, keys, deltas, lost, errors, frames ? (double)frameBytes / frames : 0.0 );
+	return 0;
+}
@@ -0,0 +1,129 @@
+//
+// ============================================================================
+//
+// telemetry.c -- Binary state stream for the servoturnout program
+//
+// ============================================================================
+//
+#include <stdint.h>
+//
+#include "hal.h"
+#include "servoturnout.h"
+//
+#include "servo.h"
+#include "button.h"
+#include "uart.h"
+#include "telemetry.h"
+//
+#ifdef UART_TELEMETRY
+//
+#ifndef UART_CONSOLE
+#error "UART_TELEMETRY is switched on and off by the console, build with UART_CONSOLE"
+#endif
+_Static_assert( TELEM_FRAME_MAX( SERVO_COUNT ) <= UART_TX_SIZE, "a telemetry frame must fit in the transmit ring, raise UART_TX_SIZE" );
+//
+// ============================================================================
+//
+uint8_t			telemMode;
+uint16_t		telemFrames;
+uint16_t		telemSkipped;
+static uint16_t	telemSent[2*SERVO_COUNT];	// Positions as of the last frame sent
+static uint8_t	telemSentBtn;				// btnState as of the last frame sent
+static uint8_t	telemSeq;					// Sequence number of the next frame
+static uint8_t	telemKeyTics;				// Tics to the next key frame, 0 for now
+//
+// ============================================================================
+// telemSetMode -- Start or stop the stream, enum eTelemMode
+//
+// A stream always starts with a key frame.
+//
+void telemSetMode( uint8_t mode )
+{
+	telemMode = mode;
+	telemKeyTics = 0;
+}
+//
+// ============================================================================
+// telemHeartBeat -- Send this tic's frame, if any
+//
+// The frame is built in full before anything is queued, so it is sent whole
+// or not at all. Field n is currentPos (n even) or targetPos (n odd) of servo
+// n/2, the last one is btnState.
+//
+void telemHeartBeat( void )
+{
+	uint8_t		frame[TELEM_FRAME_MAX( SERVO_COUNT )];
+	uint8_t *	mask = &frame[3];
+	uint8_t		n = 3;
+	uint8_t		field, key;
+	uint16_t	pos;
+	int16_t		diff;
+	uint8_t		crc = 0;
+
+	if ( telemOff == telemMode )
+		return;
+
+	if ( telemKeyTics )
+		--telemKeyTics;
+	key = ( 0 == telemKeyTics );
+
+	if ( key ) {
+		frame[n++] = SERVO_COUNT;
+	}
+	else {
+		for ( field=0; field<TELEM_MASK_BYTES( SERVO_COUNT ); ++field )
+			frame[n++] = 0;
+	}
+
+	for ( field=0; field<2*SERVO_COUNT; ++field ) {
+		pos = ( field & 1 ) ? servo[field>>1].targetPos : servo[field>>1].currentPos;
+		diff = (int16_t)(pos - telemSent[field]);
+		if ( !key ) {
+			if ( 0 == diff )
+				continue;
+			mask[field>>3] |= 1<<(field & 7);
+			if ( (diff >= -127) && (diff <= 127) ) {
+				frame[n++] = (uint8_t)diff;
+				continue;
+			}
+			frame[n++] = (uint8_t)TELEM_ESCAPE;
+		}
+		frame[n++] = (uint8_t)pos;
+		frame[n++] = (uint8_t)(pos >> 8);
+	}
+	if ( key || (btnState != telemSentBtn) ) {
+		if ( !key )
+			mask[field>>3] |= 1<<(field & 7);
+		frame[n++] = btnState;
+	}
+
+	if ( !key && (telemOnChange == telemMode) && (3 + TELEM_MASK_BYTES( SERVO_COUNT ) == n) )
+		return;								// Nothing changed
+
+	if ( uartTxFree() < n + 1 ) {
+		++telemSkipped;						// A key frame stays due
+		return;
+	}
+
+	frame[0] = TELEM_SYNC;
+	frame[1] = n - 2;
+	frame[2] = ( key ? TELEM_KEY : 0 ) | ( telemSeq++ & TELEM_SEQ );
+	for ( field=1; field<n; ++field )
+		crc = telemCrc( crc, frame[field] );
+	frame[n++] = crc;
+
+	for ( field=0; field<n; ++field )
+		uartPutc( frame[field] );
+	++telemFrames;
+
+	for ( field=0; field<2*SERVO_COUNT; ++field )
+		telemSent[field] = ( field & 1 ) ? servo[field>>1].targetPos : servo[field>>1].currentPos;
+	telemSentBtn = btnState;
+	if ( key )
+		telemKeyTics = TELEM_KEY_TICS;
+}
+//
+#endif	// UART_TELEMETRY
+//
+// ============================================================================
+//
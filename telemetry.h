@@ -0,0 +1,79 @@
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+//
+// ============================================================================
+//
+// telemetry.h -- Binary state stream for the servoturnout program, build with
+//				  -DUART_CONSOLE -DUART_TELEMETRY
+//
+// ============================================================================
+//
+// The console command "b n" sets the mode: 0 off, 1 a frame every tic, 2 a
+// frame only on tics where something changed. In both the state is sent in
+// full every TELEM_KEY_TICS.
+//
+// A frame is
+//
+//	TELEM_SYNC, length, header, payload[length-1], crc
+//
+// length counts the header and payload, crc is CRC-8 (polynomial 0x07) over
+// length, header and payload. TELEM_SYNC never occurs in console text, a
+// decoder that loses its place looks for the next one and checks the crc.
+// The header is TELEM_KEY for a key frame plus a 7 bit sequence number, a gap
+// in the sequence means a frame was lost and deltas can't be applied until
+// the next key frame.
+//
+// The state is a list of fields: currentPos and targetPos of each servo in
+// turn, in 1/8us units, then btnState.
+//
+// Key frame payload:	servo count, then every field, positions as 2 bytes
+//						low byte first
+// Delta frame payload:	a bit mask of the fields that changed since the last
+//						frame, bit n of byte n/8 for field n, then each of
+//						those fields. A position is a signed byte difference,
+//						or TELEM_ESCAPE followed by the 2 byte value when the
+//						difference doesn't fit.
+//
+// btnState is always sent as it is. A servo moving at cruise speed costs one
+// byte per tic, so two moving servos make a 7 byte frame, 350 bytes/s out of
+// the 3840 a 38400 baud link carries.
+//
+// A frame is only started when it fits in the transmit ring, otherwise the tic
+// is skipped. Deltas are taken from the last frame actually sent, so a skipped
+// tic is folded into the next frame rather than lost.
+//
+// telemdecode.c turns the stream back into text on the host.
+//
+#define TELEM_SYNC			0xA5	// Not ASCII, so never in console replies
+#define TELEM_KEY			0x80	// Header bit for a key frame
+#define TELEM_SEQ			0x7F	// Header sequence number
+#define TELEM_ESCAPE		((int8_t)0x80)	// Position difference doesn't fit a byte
+#define TELEM_KEY_TICS		SERVO_HZ	// 1s between key frames
+//
+#define TELEM_FIELDS(count)	(2*(count) + 1)
+#define TELEM_MASK_BYTES(count)	((TELEM_FIELDS( count ) + 7) / 8)
+#define TELEM_FRAME_MAX(count)	(4 + TELEM_MASK_BYTES( count ) + 6*(count) + 1)	// Worst delta frame
+//
+enum eTelemMode { telemOff, telemEveryTic, telemOnChange };
+//
+// telemCrc -- Add a byte to a CRC-8, polynomial 0x07
+static inline uint8_t telemCrc( uint8_t crc, uint8_t c )
+{
+	crc ^= c;
+	for ( uint8_t bit=0; bit<8; ++bit )
+		crc = ( crc & 0x80 ) ? (crc<<1) ^ 0x07 : (crc<<1);
+	return crc;
+}
+//
+#ifdef UART_TELEMETRY
+extern uint8_t	telemMode;			// enum eTelemMode
+extern uint16_t	telemFrames;		// Frames sent
+extern uint16_t	telemSkipped;		// Frames put off because the ring was full
+//
+void telemSetMode( uint8_t mode );	// Start or stop the stream, enum eTelemMode
+void telemHeartBeat( void );		// Send this tic's frame, if any
+#endif
+//
+// ============================================================================
+//
+#endif	// _TELEMETRY_H_
@@ -0,0 +1,175 @@
+//
+// ============================================================================
+//
+// timebase.c -- Heartbeat timebase for program servoturnout.c
+//
+// ============================================================================
+//
+#include <stdint.h>
+//
+#include "hal.h"
+#include "servoturnout.h"
+//
+#include "timebase.h"
+//
+_Static_assert( TB_BASE >= 2 && TB_BASE <= 255, "heartbeat period doesn't fit timer0" );
+_Static_assert( TB_DEN + TB_FRAC <= 0xFFFF, "tbFrac would overflow" );
+//
+// ============================================================================
+//
+volatile uint8_t	tbPending;			// Tics raised by the ISR and not yet taken
+uint32_t			tbUptime;			// Tics since reset, taken or dropped
+uint16_t			tbMissed;			// Tics dropped by the catch-up limit
+uint16_t			tbLatencyMax;		// Worst delay from a tic to tbTake(), timer0 counts
+#ifdef TB_TIMER1
+volatile uint32_t	tbClock;			// Timer1 counts up to the start of this period
+volatile uint16_t	tbTicAt;			// tbNow() of the latest tic
+#else
+static uint16_t		tbFrac;				// Fractional count accumulator, /TB_DEN
+static volatile uint16_t tbClock;		// Timer0 counts up to the start of this period
+#endif
+//
+// ============================================================================
+// tbInit -- Initialize timer0 in CTC mode w/ interrupts enabled
+//
+// Operate the timer in CTC mode, the timer repeatedly counts from zero to OCR0A,
+// and generates an TIMER0_COMPA interrupt at OCR0A.
+//
+// CS02:CS01:CS00 determines clock source and divisor
+// 0b000: Clock off
+// 0b001: ClkIO/1
+// 0b010: ClkIO/8
+// 0b011: ClkIO/64
+// 0b100: ClkIO/256
+// 0b101: ClkIO/1024
+//
+// Note: OCF0A is cleared by hardware when executing the interrupt handler, and
+// by writing a one to it.
+//
+// With TB_TIMER1 timer0 runs the same way for the LED engine, without the
+// compare A interrupt. The heartbeat interrupt is enabled with timer1.
+//
+void tbInit( void )
+{
+	TCCR0A = ((1<<WGM01) | (0<<WGM00));	// CTC Mode
+	TCCR0B = ((0<<WGM02) | (1<<CS02) | (0<<CS01) | (1<<CS00));
+	TCNT0 = 0;
+	OCR0A = TB_BASE - 1;				// The period is OCR0A+1 counts
+#ifndef TB_TIMER1
+	TIFR = (1<<OCF0A);					// Clear stale compare match
+	TIMSK |= (1<<OCIE0A);				// Interrupt when OCF0A is set
+#endif
+}
+#ifndef TB_TIMER1
+//
+// ============================================================================
+// TIMER0_COMPA -- ISR for timer 0 compare match event
+//
+// This is the heartbeat ISR. Count the tic and let the non-ISR code deal with
+// everything. OCR0A isn't buffered in CTC mode, the value written here sets the
+// length of the period that has just started.
+//
+ISR(TIMER0_COMPA_vect)
+{
+	if ( tbPending != 0xFF )
+		++tbPending;
+
+	tbClock += OCR0A + 1;				// Length of the period that just ended
+
+	tbFrac += TB_FRAC;
+	if ( tbFrac >= TB_DEN ) {
+		tbFrac -= TB_DEN;
+		OCR0A = TB_BASE;				// One count longer
+	}
+	else {
+		OCR0A = TB_BASE - 1;
+	}
+}
+//
+// ============================================================================
+// tbNow -- Timer0 counts since reset, modulo 2^16
+//
+// Safe to call from other ISRs. If timer0 has wrapped but its ISR hasn't run
+// yet, OCF0A is still set and OCR0A still holds the old period.
+//
+uint16_t tbNow( void )
+{
+	uint16_t	now;
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+		now = tbClock + TCNT0;
+		if ( TIFR & (1<<OCF0A) )
+			now = tbClock + OCR0A + 1 + TCNT0;	// Read TCNT0 again, after the wrap
+	}
+	return now;
+}
+#else	// TB_TIMER1
+//
+// ============================================================================
+// tbNow -- Timer0 counts since reset, modulo 2^16
+//
+// Made from timer1 counts, which tbClock holds in full. As with timer0, if
+// timer1 has reached TOP but its ISR hasn't run yet the flag is still set.
+//
+uint16_t tbNow( void )
+{
+	uint32_t	now;
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+		now = tbClock + TCNT1;
+		if ( TIFR & (1<<TB_T1_FLAG) )
+			now = tbClock + ICR1 + 1 + TCNT1;	// Read TCNT1 again, after the wrap
+	}
+	return now >> TB_NOW_SHIFT;
+}
+#endif	// TB_TIMER1
+//
+// ============================================================================
+// tbTake -- Take one tic, 0 if none is pending
+//
+// The ISR may add a tic at any time, so the read and the decrement are done
+// with interrupts off. A tic taken with others still pending is that many
+// periods late, plus however far timer0 is into the current period.
+//
+uint8_t tbTake( void )
+{
+	uint8_t		pending;
+	uint16_t	count;
+	uint16_t	late;
+
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+		pending = tbPending;
+#ifdef TB_TIMER1
+		count = tbTicAt;
+#else
+		count = TCNT0;
+#endif
+		if ( pending > TB_CATCHUP_MAX ) {
+			tbPending = TB_CATCHUP_MAX - 1;
+		}
+		else if ( pending ) {
+			--tbPending;
+		}
+	}
+
+	if ( 0 == pending )
+		return 0;
+
+	if ( pending > TB_CATCHUP_MAX ) {
+		tbMissed += pending - TB_CATCHUP_MAX;
+		tbUptime += pending - TB_CATCHUP_MAX;
+	}
+	++tbUptime;
+
+#ifdef TB_TIMER1
+	count = tbNow() - count;			// Time since the latest tic
+#endif
+	late = (uint16_t)(pending - 1) * TB_BASE + count;
+	if ( late > tbLatencyMax )
+		tbLatencyMax = late;
+
+	return 1;
+}
+//
+// ============================================================================
+//
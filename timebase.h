@@ -0,0 +1,94 @@
+#ifndef _TIMEBASE_H_
+#define _TIMEBASE_H_
+//
+// ============================================================================
+//
+// timebase.h -- Heartbeat timebase for program servoturnout.c
+//
+// ============================================================================
+//
+// Timer0 runs in CTC mode at clk/1024 and interrupts SERVO_HZ times a second.
+// FCPU/1024/SERVO_HZ isn't a whole number of counts (156.25 at 8MHz), so the
+// compare ISR spreads the remainder over the periods with a fractional
+// accumulator, the same way motion.c steps positions. A CTC period is OCR0A+1
+// counts, OCR0A alternates between TB_BASE-1 and TB_BASE.
+//
+// The main loop takes one tic at a time with tbTake(). When it has fallen more
+// than TB_CATCHUP_MAX tics behind the excess tics are dropped, counted in
+// tbMissed, rather than run back to back.
+//
+// tbNow() is a free running clock in timer0 counts (128us at 8MHz) for
+// timestamping events between tics. It wraps every 8.4s, only differences of
+// nearby times mean anything.
+//
+// Build with -DTB_TIMER1 to take the heartbeat from timer1 instead. The ISR
+// that ends each servo frame (overflow in the PWM modes, capture with
+// SERVO_MUX) calls tbTimer1Period(), so there is exactly one tic per PWM frame
+// at a fixed phase: the tic is raised as the frame starts, the servos are
+// stepped in the main loop, and the OCR1x values they write are latched at the
+// start of the next frame. With the timer0 heartbeat the two timers beat
+// against each other and an OCR1x write can land either side of BOTTOM. Timer0
+// keeps running for the LED engine but has no heartbeat interrupt. tbNow()
+// counts timer1 counts >> TB_NOW_SHIFT, the same 128us units.
+//
+// Needs servoturnout.h
+//
+#define TB_PRESCALE			1024L
+#define TB_DEN				(TB_PRESCALE*SERVO_HZ)		// Counts per period = FCPU/TB_DEN
+#define TB_BASE				(FCPU/TB_DEN)				// Whole counts per period
+#define TB_FRAC				(FCPU%TB_DEN)				// Fraction of a count per period, /TB_DEN
+#define TB_MS(ms)			((uint16_t)((FCPU/TB_PRESCALE)*(ms)/1000))	// tbNow() counts in ms
+//
+#ifdef TB_TIMER1
+#ifdef SERVO_HIRES
+#define TB_NOW_SHIFT		10		// 1024 timer1 counts of 1/8us
+#else
+#define TB_NOW_SHIFT		7		// 128 timer1 counts of 1us
+#endif
+#ifdef SERVO_MUX
+#define TB_T1_FLAG			ICF1	// Set at TOP in CTC mode 12
+#else
+#define TB_T1_FLAG			TOV1	// Set at TOP in fast PWM mode 14
+#endif
+#endif	// TB_TIMER1
+//
+#ifndef TB_CATCHUP_MAX
+#define TB_CATCHUP_MAX		4		// Most tics handled back to back after a stall
+#endif
+//
+extern volatile uint8_t	tbPending;		// Tics raised by the ISR and not yet taken
+extern uint32_t	tbUptime;				// Tics since reset, taken or dropped
+extern uint16_t	tbMissed;				// Tics dropped by the catch-up limit
+extern uint16_t	tbLatencyMax;			// Worst delay from a tic to tbTake(), timer0 counts
+#ifdef TB_TIMER1
+extern volatile uint32_t tbClock;		// Timer1 counts up to the start of this period
+extern volatile uint16_t tbTicAt;		// tbNow() of the latest tic
+#endif
+//
+#define tbReady()			(tbPending != 0)
+//
+void tbInit( void );					// Start the heartbeat
+uint8_t tbTake( void );					// Take one tic, 0 if none is pending
+uint16_t tbNow( void );					// Timer0 counts since reset, modulo 2^16
+#ifdef TB_TIMER1
+//
+// ============================================================================
+// tbTimer1Period -- Count a timer1 period, from the ISR at its TOP
+//
+// tic is set on the last period of a servo frame. Inline, so the ISR doesn't
+// have to save every call clobbered register for it.
+//
+static inline void tbTimer1Period( uint8_t tic )
+{
+	tbClock += ICR1 + 1;
+	if ( tic ) {
+		tbTicAt = tbClock >> TB_NOW_SHIFT;
+		if ( tbPending != 0xFF )
+			++tbPending;
+	}
+}
+#endif	// TB_TIMER1
+//
+// ============================================================================
+//
+#endif	// _TIMEBASE_H_
@@ -0,0 +1,375 @@
+//
+// ============================================================================
+//
+// twi.c -- USI TWI (I2C) slave for the servoturnout program
+//
+// ============================================================================
+//
+#include <stdint.h>
+//
+#include "hal.h"
+#include "servoturnout.h"
+//
+#include "servo.h"
+#include "rom.h"
+#include "twi.h"
+//
+#ifdef TWI_SLAVE
+//
+#ifdef SERVO_MUX
+#error "SERVO_MUX and TWI_SLAVE both need PB5 and PB7"
+#endif
+_Static_assert( (TWI_QUEUE_SIZE & (TWI_QUEUE_SIZE-1)) == 0, "write queue size must be a power of two" );
+_Static_assert( SERVO_COUNT <= 8, "the servo bit masks are one byte" );
+//
+#define TWI_QUEUE_MASK		(TWI_QUEUE_SIZE-1)
+//
+// USICR: start condition interrupt, two wire mode, external clock. While a
+// transaction is ours the counter overflow interrupt is on too and SCL is held
+// low after each overflow until USISR is written.
+#define TWI_CR_IDLE			((1<<USISIE) | (1<<USIWM1) | (1<<USICS1))
+#define TWI_CR_ACTIVE		((1<<USISIE) | (1<<USIOIE) | (1<<USIWM1) | (1<<USIWM0) | (1<<USICS1))
+//
+// USISR: clear the overflow, stop and collision flags and load the counter,
+// which counts both SCL edges. 0 overflows after a byte, 14 after one bit.
+#define TWI_SR_BYTE			((1<<USIOIF) | (1<<USIPF) | (1<<USIDC) | 0x00)
+#define TWI_SR_BIT			((1<<USIOIF) | (1<<USIPF) | (1<<USIDC) | 0x0E)
+//
+// What the next counter overflow means
+enum eTwiState {
+	twiStateAddress,		// Address byte received
+	twiStateSend,			// Our ACK of a read address sent, send a byte
+	twiStateSent,			// A byte sent, read the master's ACK
+	twiStateAck,			// The master's ACK of a byte read
+	twiStateRequest,		// Our ACK of a write sent, receive a byte
+	twiStateReceive,		// A byte received
+};
+//
+// ============================================================================
+//
+uint8_t		twiAddress;
+uint16_t	twiWrites;
+uint16_t	twiRejects;
+uint8_t		twiNacks;
+//
+static uint8_t			twiRegs[TWI_REG_SIZE];	// Register map as read by the master
+static uint8_t			twiState;			// enum eTwiState, owned by the ISRs
+static uint8_t			twiPtr;				// Register pointer
+static uint8_t			twiFirst;			// Next byte written sets twiPtr
+static uint8_t			twiLatch;			// High byte of a word being read, low of one being written
+//
+// Write queue. twiQHead is only written by the ISR, twiQTail only by twiPoll(),
+// both count freely and are masked on use.
+static uint8_t			twiQReg[TWI_QUEUE_SIZE];
+static uint16_t			twiQValue[TWI_QUEUE_SIZE];
+static volatile uint8_t	twiQHead;
+static volatile uint8_t	twiQTail;
+//
+// ============================================================================
+// twiInit -- Load the bus address and start listening for a start condition
+//
+// SCL is an output so the USI can hold it low. Both pins are open drain in two
+// wire mode, the pull-ups are on as well in case the bus has none.
+//
+void twiInit( void )
+{
+	twiAddress = romConfigRead( ROM_ADDR_TWI, TWI_DEFAULT_ADDRESS );
+	if ( (twiAddress < TWI_ADDRESS_MIN) || (twiAddress > TWI_ADDRESS_MAX) )
+		twiAddress = TWI_DEFAULT_ADDRESS;
+	twiHeartBeat();
+
+	PORTB |= (1<<TWI_SDA) | (1<<TWI_SCL);
+	DDRB |= (1<<TWI_SCL);
+	DDRB &= ~(1<<TWI_SDA);
+	USICR = TWI_CR_IDLE;
+	USISR = (1<<USISIF) | TWI_SR_BYTE;
+}
+//
+// ============================================================================
+// twiRelease -- Let go of SDA and wait for the next start condition
+//
+// Used to NACK: the master sees SDA high on the acknowledge bit.
+//
+static void twiRelease( void )
+{
+	DDRB &= ~(1<<TWI_SDA);
+	USICR = TWI_CR_IDLE;
+	USISR = TWI_SR_BYTE;
+}
+//
+// ============================================================================
+// twiAck -- Drive SDA low for one bit
+//
+static void twiAck( void )
+{
+	USIDR = 0;
+	DDRB |= (1<<TWI_SDA);
+	USISR = TWI_SR_BIT;
+}
+//
+// ============================================================================
+// twiReadReg -- Next register for the master to read
+//
+static uint8_t twiReadReg( void )
+{
+	uint8_t reg = twiPtr++;
+
+	if ( reg >= TWI_REG_SIZE )
+		return 0xFF;
+	if ( reg < TWI_REG_SERVO( 0 ) )
+		return twiRegs[reg];
+	if ( reg & 1 )
+		return twiLatch;
+	twiLatch = twiRegs[reg+1];
+	return twiRegs[reg];
+}
+//
+// ============================================================================
+// twiWriteReg -- Take a byte the master wrote
+//
+// return 0 to NACK it
+//
+static uint8_t twiWriteReg( uint8_t value )
+{
+	uint8_t		reg;
+	uint8_t		head = twiQHead;
+
+	if ( twiFirst ) {
+		twiFirst = 0;
+		twiPtr = value;
+		return 1;
+	}
+
+	reg = twiPtr++;
+	if ( reg < TWI_REG_SERVO( 0 ) ) {
+		if ( (reg < TWI_REG_ADDRESS) || (reg > TWI_REG_TOGGLE) )
+			return 0;
+	}
+	else {
+		if ( reg >= TWI_REG_SIZE )
+			return 0;
+		switch ( reg & 7 ) {
+			case TWI_SERVO_MIN:
+			case TWI_SERVO_MAX:
+				twiLatch = value;
+				return 1;
+			case TWI_SERVO_MIN+1:
+			case TWI_SERVO_MAX+1:
+				--reg;
+				break;
+			default:
+				return 0;
+		}
+	}
+
+	if ( (uint8_t)(head - twiQTail) >= TWI_QUEUE_SIZE )
+		return 0;
+	twiQReg[head & TWI_QUEUE_MASK] = reg;
+	twiQValue[head & TWI_QUEUE_MASK] = ( reg < TWI_REG_SERVO( 0 ) ) ? value : (twiLatch | ((uint16_t)value << 8));
+	twiQHead = head + 1;
+	return 1;
+}
+//
+// ============================================================================
+// USI_START -- ISR, start condition on the bus
+//
+// The start condition ends when the master pulls SCL low, or is cut short by a
+// stop if SDA goes high first. Either happens within the start hold time, 4us
+// at 100kHz, so the wait is bounded.
+//
+ISR(USI_START_vect)
+{
+	twiState = twiStateAddress;
+	DDRB &= ~(1<<TWI_SDA);
+
+	while ( (PINB & (1<<TWI_SCL)) && !(PINB & (1<<TWI_SDA)) )
+		;
+
+	USICR = ( PINB & (1<<TWI_SDA) ) ? TWI_CR_IDLE : TWI_CR_ACTIVE;
+	USISR = (1<<USISIF) | TWI_SR_BYTE;
+}
+//
+// ============================================================================
+// USI_OVERFLOW -- ISR, a byte or an acknowledge bit has been clocked
+//
+ISR(USI_OVERFLOW_vect)
+{
+	switch ( twiState ) {
+		case twiStateAddress:
+			if ( (USIDR >> 1) != twiAddress ) {
+				twiRelease();
+				return;
+			}
+			if ( USIDR & 1 ) {
+				twiState = twiStateSend;
+			}
+			else {
+				twiState = twiStateRequest;
+				twiFirst = 1;
+			}
+			twiAck();
+			break;
+
+		case twiStateAck:
+			if ( USIDR & 1 ) {
+				twiRelease();				// NACK, the master has read enough
+				return;
+			}
+			// fall through
+		case twiStateSend:
+			USIDR = twiReadReg();
+			DDRB |= (1<<TWI_SDA);
+			USISR = TWI_SR_BYTE;
+			twiState = twiStateSent;
+			break;
+
+		case twiStateSent:
+			DDRB &= ~(1<<TWI_SDA);
+			USIDR = 0;
+			USISR = TWI_SR_BIT;
+			twiState = twiStateAck;
+			break;
+
+		case twiStateRequest:
+			DDRB &= ~(1<<TWI_SDA);
+			USISR = TWI_SR_BYTE;
+			twiState = twiStateReceive;
+			break;
+
+		default:	// twiStateReceive
+			if ( !twiWriteReg( USIDR ) ) {
+				if ( twiNacks != 0xFF )
+					++twiNacks;
+				twiRelease();
+				return;
+			}
+			twiAck();
+			twiState = twiStateRequest;
+			break;
+	}
+}
+//
+// ============================================================================
+// twiSetWord -- Store a word in the register map
+//
+// With interrupts off, the ISR latches both bytes when the low one is read.
+//
+static void twiSetWord( uint8_t reg, uint16_t value )
+{
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+		twiRegs[reg] = (uint8_t)value;
+		twiRegs[reg+1] = value >> 8;
+	}
+}
+//
+// ============================================================================
+// twiHeartBeat -- Refresh the register map from the servo data
+//
+void twiHeartBeat( void )
+{
+	uint8_t		target = 0;
+	uint8_t		moving = 0;
+	uint8_t		reg;
+
+	for ( uint8_t idx=0; idx<SERVO_COUNT; ++idx ) {
+		const servoData_t * s = &servo[idx];
+
+		if ( s->targetPos == s->maxPos )
+			target |= 1<<idx;
+		if ( s->currentPos != s->targetPos )
+			moving |= 1<<idx;
+
+		reg = TWI_REG_SERVO( idx );
+		twiSetWord( reg + TWI_SERVO_TARGET, s->targetPos );
+		twiSetWord( reg + TWI_SERVO_MIN, s->minPos );
+		twiSetWord( reg + TWI_SERVO_MAX, s->maxPos );
+		twiSetWord( reg + TWI_SERVO_CURRENT, s->currentPos );
+	}
+
+	twiRegs[TWI_REG_ID] = TWI_ID;
+	twiRegs[TWI_REG_COUNT] = SERVO_COUNT;
+	twiRegs[TWI_REG_ADDRESS] = twiAddress;
+	twiRegs[TWI_REG_TARGET] = target;
+	twiRegs[TWI_REG_MOVING] = moving;
+}
+//
+// ============================================================================
+// twiApply -- Carry out one queued register write
+//
+// A write with a bad value is dropped and counted in twiRejects.
+//
+// return 0 to leave it queued and try again later
+//
+static uint8_t twiApply( uint8_t reg, uint16_t value )
+{
+	uint8_t		idx;
+
+	switch ( reg ) {
+		case TWI_REG_ADDRESS:
+			if ( (value < TWI_ADDRESS_MIN) || (value > TWI_ADDRESS_MAX) ) {
+				++twiRejects;
+				return 1;
+			}
+			if ( !romConfigWrite( ROM_ADDR_TWI, value ) )
+				return 0;
+			twiAddress = value;
+			break;
+
+		case TWI_REG_TARGET:
+			for ( idx=0; idx<SERVO_COUNT; ++idx )
+				servoSelect( idx, value & (1<<idx) );
+			break;
+
+		case TWI_REG_SET:
+		case TWI_REG_CLEAR:
+			for ( idx=0; idx<SERVO_COUNT; ++idx ) {
+				if ( value & (1<<idx) )
+					servoSelect( idx, TWI_REG_SET == reg );
+			}
+			break;
+
+		case TWI_REG_TOGGLE:
+			for ( idx=0; idx<SERVO_COUNT; ++idx ) {
+				if ( value & (1<<idx) )
+					servoToggle( idx );
+			}
+			break;
+
+		default:	// TWI_SERVO_MIN or TWI_SERVO_MAX
+			idx = ( reg - TWI_REG_SERVO( 0 ) ) >> 3;
+			if ( !servoSetLimit( idx, value, TWI_SERVO_MAX == (reg & 7) ) ) {
+				++twiRejects;
+				return 1;
+			}
+			break;
+	}
+	++twiWrites;
+	return 1;
+}
+//
+// ============================================================================
+// twiPoll -- Apply the register writes the ISR has queued
+//
+// Called on every pass of the main loop. The register map is refreshed
+// afterwards so the master reads back what it did.
+//
+void twiPoll( void )
+{
+	uint8_t		tail = twiQTail;
+
+	if ( tail == twiQHead )
+		return;
+
+	do {
+		if ( !twiApply( twiQReg[tail & TWI_QUEUE_MASK], twiQValue[tail & TWI_QUEUE_MASK] ) )
+			break;							// EEPROM queue full, retry next pass
+		twiQTail = ++tail;
+	} while ( tail != twiQHead );
+
+	twiHeartBeat();
+}
+//
+#endif	// TWI_SLAVE
+//
+// ============================================================================
+//
@@ -0,0 +1,88 @@
+#ifndef _TWI_H_
+#define _TWI_H_
+//
+// ============================================================================
+//
+// twi.h -- USI TWI (I2C) slave for the servoturnout program, build with
+//			-DTWI_SLAVE
+//
+// ============================================================================
+//
+// SDA is PB5 (DI) and SCL is PB7 (USCK), the MOSI and SCK pins of the ISP
+// header, so boards can be daisy chained to a panel with the same cable.
+// SERVO_MUX has servos on those pins and can't be combined with TWI_SLAVE.
+//
+// The USI start condition interrupt wakes the CPU and arms the counter overflow
+// interrupt, which then runs once per byte and once per acknowledge bit with
+// SCL held low. Every step is a fixed amount of work, so each byte stretches
+// the clock for no longer than one short ISR whatever the main loop is doing.
+// The ISR never touches servo[]:
+//	- Reads come from twiRegs[], a copy of the register map that
+//	  twiHeartBeat() refreshes every tic and twiPoll() after a command.
+//	- Writes are queued as (register, value) and twiPoll() applies them on the
+//	  next pass of the main loop. A write the queue can't take, or to a read
+//	  only register, is not acknowledged so the master knows to retry.
+// The low byte of a 16 bit register latches the high byte, for reads and for
+// writes, so a word is never torn.
+//
+// A write sets the register pointer with its first data byte, further bytes go
+// to consecutive registers. A read starts at the pointer and also advances it.
+//
+// Register map, words are little endian in 1/8us units (see servo.h):
+//	0x00	TWI_REG_ID		r	TWI_ID
+//	0x01	TWI_REG_COUNT	r	SERVO_COUNT
+//	0x02	TWI_REG_ADDRESS	rw	Bus address, used from the next transaction and
+//							saved in EEPROM (ROM_ADDR_TWI)
+//	0x03	TWI_REG_TARGET	rw	Bit n set: servo n goes to maxPos, clear: minPos
+//	0x04	TWI_REG_SET		w	Bit n set sends servo n to maxPos
+//	0x05	TWI_REG_CLEAR	w	Bit n set sends servo n to minPos
+//	0x06	TWI_REG_TOGGLE	w	Bit n set reverses servo n
+//	0x07	TWI_REG_MOVING	r	Bit n set while servo n is away from targetPos
+//	0x08+8n	servo n, the servoData_t fields
+//		+0	TWI_SERVO_TARGET	r	targetPos
+//		+2	TWI_SERVO_MIN		rw	minPos
+//		+4	TWI_SERVO_MAX		rw	maxPos
+//		+6	TWI_SERVO_CURRENT	r	currentPos
+// Write only registers read 0, registers past the map read 0xFF.
+//
+// Needs servoturnout.h and servo.h
+//
+#ifndef TWI_DEFAULT_ADDRESS
+#define TWI_DEFAULT_ADDRESS	0x28	// Until one is written to TWI_REG_ADDRESS
+#endif
+#define TWI_ADDRESS_MIN		0x08	// 7 bit addresses outside this range are reserved
+#define TWI_ADDRESS_MAX		0x77
+//
+#define TWI_SDA				PB5
+#define TWI_SCL				PB7
+//
+#define TWI_ID				0x53	// 'S'
+#define TWI_REG_ID			0x00
+#define TWI_REG_COUNT		0x01
+#define TWI_REG_ADDRESS		0x02
+#define TWI_REG_TARGET		0x03
+#define TWI_REG_SET			0x04
+#define TWI_REG_CLEAR		0x05
+#define TWI_REG_TOGGLE		0x06
+#define TWI_REG_MOVING		0x07
+#define TWI_REG_SERVO(n)	(0x08 + 8*(n))
+#define TWI_SERVO_TARGET	0
+#define TWI_SERVO_MIN		2
+#define TWI_SERVO_MAX		4
+#define TWI_SERVO_CURRENT	6
+#define TWI_REG_SIZE		TWI_REG_SERVO( SERVO_COUNT )
+//
+#define TWI_QUEUE_SIZE		4		// Power of two
+//
+extern uint8_t	twiAddress;			// Our 7 bit bus address
+extern uint16_t	twiWrites;			// Register writes applied
+extern uint16_t	twiRejects;			// Writes dropped for a bad value
+extern uint8_t	twiNacks;			// Bytes not acknowledged, queue full or read only
+//
+void twiInit( void );					// Load the address and start listening
+void twiPoll( void );					// Apply queued register writes
+void twiHeartBeat( void );				// Refresh the readable registers
+//
+// ============================================================================
+//
+#endif	// _TWI_H_
@@ -0,0 +1,167 @@
+//
+// ============================================================================
+//
+// uart.c -- Interrupt driven USART for the servoturnout program
+//
+// ============================================================================
+//
+#include <stdint.h>
+//
+#include "hal.h"
+#include "servoturnout.h"
+//
+#include "uart.h"
+//
+#ifdef UART_CONSOLE
+//
+_Static_assert( (UART_RX_SIZE & (UART_RX_SIZE-1)) == 0, "receive ring size must be a power of two" );
+_Static_assert( (UART_TX_SIZE & (UART_TX_SIZE-1)) == 0, "transmit ring size must be a power of two" );
+_Static_assert( UART_UBRR <= 4095, "UART_BAUD out of range" );
+//
+#define UART_RX_MASK		(UART_RX_SIZE-1)
+#define UART_TX_MASK		(UART_TX_SIZE-1)
+//
+// ============================================================================
+//
+uint8_t	uartRxOverflows;
+uint8_t	uartTxDrops;
+//
+// Each head is only written by the producer, each tail by the consumer. Both
+// count freely and are masked on use.
+static uint8_t			uartRx[UART_RX_SIZE];
+static volatile uint8_t	uartRxHead;
+static volatile uint8_t	uartRxTail;
+static uint8_t			uartTx[UART_TX_SIZE];
+static volatile uint8_t	uartTxHead;
+static volatile uint8_t	uartTxTail;
+//
+// ============================================================================
+// uartInit -- Configure the USART for 8N1 at UART_BAUD
+//
+// Double speed mode halves the baud rate error from the internal oscillator.
+//
+void uartInit( void )
+{
+	UBRRH = (uint8_t)(UART_UBRR >> 8);
+	UBRRL = (uint8_t)UART_UBRR;
+	UCSRA = (1<<U2X);
+	UCSRC = ((1<<UCSZ1) | (1<<UCSZ0));		// Asynchronous, no parity, 1 stop bit, 8 bits
+	UCSRB = ((1<<RXCIE) | (1<<RXEN) | (1<<TXEN));
+}
+//
+// ============================================================================
+// USART_RX -- ISR, store a received byte
+//
+ISR(USART_RX_vect)
+{
+	uint8_t head = uartRxHead;
+	uint8_t c = UDR;						// Reading UDR clears RXC
+
+	if ( (uint8_t)(head - uartRxTail) >= UART_RX_SIZE ) {
+		if ( uartRxOverflows != 0xFF )
+			++uartRxOverflows;
+		return;
+	}
+	uartRx[head & UART_RX_MASK] = c;
+	uartRxHead = head + 1;
+}
+//
+// ============================================================================
+// USART_UDRE -- ISR, send the next queued byte
+//
+// Fires whenever UDR is empty and UDRIE is set. When the ring is empty the
+// interrupt disables itself, uartPutc() enables it again.
+//
+ISR(USART_UDRE_vect)
+{
+	uint8_t tail = uartTxTail;
+
+	if ( tail == uartTxHead ) {
+		UCSRB &= ~(1<<UDRIE);
+		return;
+	}
+	UDR = uartTx[tail & UART_TX_MASK];
+	uartTxTail = tail + 1;
+}
+//
+// ============================================================================
+// uartRxCount -- Bytes waiting in the receive ring
+//
+uint8_t uartRxCount( void )
+{
+	return uartRxHead - uartRxTail;
+}
+//
+// ============================================================================
+// uartGetc -- Take the next received byte, call only if uartRxCount() != 0
+//
+uint8_t uartGetc( void )
+{
+	uint8_t tail = uartRxTail;
+	uint8_t c = uartRx[tail & UART_RX_MASK];
+
+	uartRxTail = tail + 1;
+	return c;
+}
+//
+// ============================================================================
+// uartTxFree -- Bytes uartPutc() can take without dropping any
+//
+uint8_t uartTxFree( void )
+{
+	return UART_TX_SIZE - (uint8_t)(uartTxHead - uartTxTail);
+}
+//
+// ============================================================================
+// uartPutc -- Queue a byte for the transmitter, drop it if the ring is full
+//
+// UCSRB is also written by the UDRE ISR, so the read-modify-write is atomic.
+//
+void uartPutc( uint8_t c )
+{
+	uint8_t head = uartTxHead;
+
+	if ( (uint8_t)(head - uartTxTail) >= UART_TX_SIZE ) {
+		if ( uartTxDrops != 0xFF )
+			++uartTxDrops;
+		return;
+	}
+	uartTx[head & UART_TX_MASK] = c;
+	uartTxHead = head + 1;
+	ATOMIC_BLOCK( ATOMIC_RESTORESTATE ) {
+		UCSRB |= (1<<UDRIE);
+	}
+}
+//
+// ============================================================================
+// uartPuts_P -- Queue a string from PROGMEM
+//
+void uartPuts_P( const char * s )
+{
+	char c;
+
+	while ( (c = pgm_read_byte( s++ )) != 0 )
+		uartPutc( c );
+}
+//
+// ============================================================================
+// uartPutDec -- Queue an unsigned number in decimal, no leading zeros
+//
+void uartPutDec( uint16_t value )
+{
+	char	digits[5];
+	uint8_t	n = 0;
+
+	do {
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while ( value );
+
+	while ( n )
+		uartPutc( digits[--n] );
+}
+//
+#endif	// UART_CONSOLE
+//
+// ============================================================================
+//
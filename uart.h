@@ -0,0 +1,50 @@
+#ifndef _UART_H_
+#define _UART_H_
+//
+// ============================================================================
+//
+// uart.h -- Interrupt driven USART for the servoturnout program, build with
+//			 -DUART_CONSOLE
+//
+// ============================================================================
+//
+// RXD and TXD are PD0 and PD1, the BTPLUS and BTMINUS pins, so a console build
+// has no BTNPLUS/BTNMINUS buttons. Their functions are console commands instead.
+//
+// Both directions go through a RAM ring buffer. The receive ISR stores one
+// byte, the data register empty ISR sends one and disables itself when the
+// transmit ring is empty. Neither side ever waits: uartPutc() drops the byte
+// and counts it if the ring is full, the receive ISR does the same when the
+// main loop hasn't kept up. Callers that mustn't lose output check
+// uartTxFree() first.
+//
+// The receive interrupt wakes the CPU from idle sleep, so the rings are
+// emptied between tics as well as on them and UART_RX_SIZE only has to cover
+// the time to run one command.
+//
+// Needs servoturnout.h
+//
+#ifndef UART_BAUD
+#define UART_BAUD			38400L
+#endif
+#define UART_UBRR			((FCPU + 4*UART_BAUD) / (8*UART_BAUD) - 1)	// Double speed mode
+//
+#define UART_RX_SIZE		16		// Power of two
+#ifndef UART_TX_SIZE
+#define UART_TX_SIZE		32		// Power of two
+#endif
+//
+extern uint8_t	uartRxOverflows;	// Bytes lost because the receive ring was full
+extern uint8_t	uartTxDrops;		// Bytes dropped because the transmit ring was full
+//
+void uartInit( void );					// 8N1 at UART_BAUD, interrupts enabled
+uint8_t uartRxCount( void );			// Bytes waiting in the receive ring
+uint8_t uartGetc( void );				// Next received byte, only if uartRxCount()
+uint8_t uartTxFree( void );				// Bytes uartPutc() can take without dropping
+void uartPutc( uint8_t c );				// Queue a byte, dropped if the ring is full
+void uartPuts_P( const char * s );		// Queue a PROGMEM string
+void uartPutDec( uint16_t value );		// Queue a number in decimal
+//
+// ============================================================================
+//
+#endif	// _UART_H_